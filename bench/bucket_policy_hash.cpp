@@ -0,0 +1,124 @@
+// Insert, hit and miss times of UnorderedMap under each bucket policy with a good and two bad hash
+// functions. MaskBucketPolicy is a power-of-two table that keeps the low bits of the hash without the
+// Fibonacci step, to show what PowerOfTwoBucketPolicy protects against: identity hashes of strided keys
+// and hashes whose low bits never change.
+//   g++ -std=c++17 -O2 bucket_policy_hash.cpp -o bucket_policy_hash
+//   ./bucket_policy_hash [keys]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "../unordered_map.h"
+
+static size_t sink = 0;
+
+struct MaskBucketPolicy {
+  size_t mask_ = 31;
+
+  size_t bucket_count(size_t n) const {
+    return PowerOfTwoBucketPolicy().bucket_count(n);
+  }
+
+  void resize(size_t n) {
+    mask_ = n - 1;
+  }
+
+  size_t index(size_t hash) const {
+    return hash & mask_;
+  }
+};
+
+struct MixHash {
+  size_t operator()(uint64_t key) const {
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ull;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBull;
+    return static_cast<size_t>(key ^ (key >> 31));
+  }
+};
+
+// Only the top 32 bits vary for keys below 2^32.
+struct HighBitsHash {
+  size_t operator()(uint64_t key) const {
+    return static_cast<size_t>(key << 32);
+  }
+};
+
+template <typename F>
+static double ns_per_op(size_t ops, F&& f) {
+  auto started = std::chrono::steady_clock::now();
+  f();
+  double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+  return elapsed / static_cast<double>(ops);
+}
+
+// keys[0, n) are inserted, keys[n, 2n) are only used for failed lookups.
+template <typename Hash, typename Policy>
+static void run(const char* policy, const char* hash, const std::vector<uint64_t>& keys, size_t n) {
+  UnorderedMap<uint64_t, uint64_t, Hash, std::equal_to<uint64_t>, std::allocator<std::pair<const uint64_t, uint64_t>>,
+               Policy> map;
+  double insert = ns_per_op(n, [&] {
+    for (size_t i = 0; i < n; ++i) {
+      map[keys[i]] = i;
+    }
+  });
+  double hit = ns_per_op(n, [&] {
+    for (size_t i = 0; i < n; ++i) {
+      sink += map.find(keys[i])->second;
+    }
+  });
+  double miss = ns_per_op(n, [&] {
+    for (size_t i = n; i < 2 * n; ++i) {
+      sink += map.find(keys[i]) == map.end();
+    }
+  });
+  size_t longest = 0;
+  for (size_t bucket = 0; bucket < map.bucket_count(); ++bucket) {
+    longest = std::max(longest, map.bucket_size(bucket));
+  }
+  std::printf("%-12s %-10s %10.1f %10.1f %10.1f %12zu\n", policy, hash, insert, hit, miss, longest);
+}
+
+template <typename Policy>
+static void run_policy(const char* policy, const std::vector<uint64_t>& keys, size_t n) {
+  run<MixHash, Policy>(policy, "mix", keys, n);
+  run<std::hash<uint64_t>, Policy>(policy, "identity", keys, n);
+  if (std::is_same<Policy, MaskBucketPolicy>::value) {
+    std::printf("%-12s %-10s   skipped: every key lands in bucket 0\n", policy, "high bits");
+  } else {
+    run<HighBitsHash, Policy>(policy, "high bits", keys, n);
+  }
+}
+
+static void run_keys(const char* title, const std::vector<uint64_t>& keys, size_t n) {
+  std::printf("%s, %zu keys\n%-12s %-10s %10s %10s %10s %12s\n", title, n, "policy", "hash", "insert ns", "hit ns",
+              "miss ns", "max bucket");
+  run_policy<PowerOfTwoBucketPolicy>("power of two", keys, n);
+  run_policy<PrimeBucketPolicy>("prime", keys, n);
+  run_policy<MaskBucketPolicy>("mask", keys, n);
+  std::printf("\n");
+}
+
+int main(int argc, char** argv) {
+  size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+  std::vector<uint64_t> keys(2 * n);
+  for (size_t i = 0; i < 2 * n; ++i) {
+    keys[i] = i;
+  }
+  run_keys("sequential", keys, n);
+  for (size_t i = 0; i < 2 * n; ++i) {
+    keys[i] = i * 1024;
+  }
+  run_keys("stride 1024", keys, n);
+  std::mt19937_64 gen(42);
+  for (uint64_t& key : keys) {
+    key = gen() & 0xFFFFFFFFull;
+  }
+  run_keys("random 32-bit", keys, n);
+  return sink == 42;
+}
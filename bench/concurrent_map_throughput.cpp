@@ -0,0 +1,161 @@
+// Throughput of ConcurrentUnorderedMap as threads are added, for several shard counts and read
+// ratios. The "mutex" rows use the same sharding with a plain std::mutex per shard, to compare
+// against the shared_mutex the map uses.
+//   g++ -std=c++17 -O2 concurrent_map_throughput.cpp -o concurrent_map_throughput -pthread
+//   ./concurrent_map_throughput [seconds per run] [max threads]
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../unordered_map.h"
+
+static const uint64_t key_range = 1 << 20;
+
+class MutexShardedMap {
+ private:
+  struct alignas(64) Shard {
+    std::mutex mutex;
+    UnorderedMap<uint64_t, uint64_t> map;
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+  size_t shard_count_;
+  size_t shard_shift_;
+
+  Shard& shard_for(uint64_t key) {
+    if (shard_count_ == 1) {
+      return shards_[0];
+    }
+    return shards_[(std::hash<uint64_t>()(key) * 0xff51afd7ed558ccdULL) >> shard_shift_];
+  }
+
+ public:
+  explicit MutexShardedMap(size_t shard_count) {
+    size_t bits = 0;
+    while ((size_t(1) << bits) < shard_count) {
+      ++bits;
+    }
+    shard_count_ = size_t(1) << bits;
+    shard_shift_ = 64 - bits;
+    shards_.reset(new Shard[shard_count_]);
+  }
+
+  bool contains(uint64_t key) {
+    Shard& shard = shard_for(key);
+    std::lock_guard lock(shard.mutex);
+    return shard.map.contains(key);
+  }
+
+  void insert(uint64_t key, uint64_t value) {
+    Shard& shard = shard_for(key);
+    std::lock_guard lock(shard.mutex);
+    shard.map.try_emplace(key, value);
+  }
+
+  void erase(uint64_t key) {
+    Shard& shard = shard_for(key);
+    std::lock_guard lock(shard.mutex);
+    shard.map.erase(key);
+  }
+};
+
+// Runs `threads` workers for `seconds`; reads_percent of the operations are lookups and the rest
+// alternate between insert and erase, so the size stays near half the key range.
+template <typename Map>
+double run(Map& map, size_t threads, double seconds, unsigned reads_percent) {
+  std::atomic<bool> start{false};
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> total{0};
+  std::atomic<uint64_t> hits{0};
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      std::mt19937_64 gen(t + 1);
+      uint64_t done = 0;
+      uint64_t found = 0;
+      while (!start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 256; ++i, ++done) {
+          uint64_t random = gen();
+          uint64_t key = random % key_range;
+          if ((random >> 40) % 100 < reads_percent) {
+            found += map.contains(key);
+          } else if ((random >> 32) & 1) {
+            map.insert(key, random);
+          } else {
+            map.erase(key);
+          }
+        }
+      }
+      total.fetch_add(done, std::memory_order_relaxed);
+      hits.fetch_add(found, std::memory_order_relaxed);
+    });
+  }
+  auto started = std::chrono::steady_clock::now();
+  start.store(true, std::memory_order_release);
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop.store(true, std::memory_order_relaxed);
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  return static_cast<double>(total.load()) / elapsed / 1e6;
+}
+
+template <typename Map>
+void fill(Map& map) {
+  for (uint64_t key = 0; key < key_range; key += 2) {
+    map.insert(key, key);
+  }
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? std::atof(argv[1]) : 0.5;
+  size_t hardware = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  size_t max_threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2 * hardware;
+  std::vector<size_t> thread_counts;
+  for (size_t threads = 1; threads < max_threads; threads *= 2) {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(max_threads);
+
+  std::printf("hardware threads: %zu, Mops/s\n", hardware);
+  std::printf("%-8s %6s %6s", "lock", "shards", "reads");
+  for (size_t threads : thread_counts) {
+    std::printf(" %7zut", threads);
+  }
+  std::printf("\n");
+  std::vector<size_t> shard_counts{1};
+  for (size_t shards : {hardware, 4 * hardware, 16 * hardware}) {
+    if (shards != shard_counts.back()) {
+      shard_counts.push_back(shards);
+    }
+  }
+  for (unsigned reads_percent : {100u, 90u, 50u}) {
+    for (size_t shards : shard_counts) {
+      std::printf("%-8s %6zu %5u%%", "shared", shards, reads_percent);
+      for (size_t threads : thread_counts) {
+        ConcurrentUnorderedMap<uint64_t, uint64_t> map(shards);
+        fill(map);
+        std::printf(" %8.2f", run(map, threads, seconds, reads_percent));
+        std::fflush(stdout);
+      }
+      std::printf("\n%-8s %6zu %5u%%", "mutex", shards, reads_percent);
+      for (size_t threads : thread_counts) {
+        MutexShardedMap map(shards);
+        fill(map);
+        std::printf(" %8.2f", run(map, threads, seconds, reads_percent));
+        std::fflush(stdout);
+      }
+      std::printf("\n");
+    }
+  }
+}
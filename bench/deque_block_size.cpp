@@ -0,0 +1,105 @@
+// Push, pop, random access and iteration over Deque for element sizes from 1 to 256 bytes, with
+// the old fixed block of 32 elements against the default deque_bucket_size<T>() block.
+//   g++ -std=c++17 -O2 deque_block_size.cpp -o deque_block_size
+//   ./deque_block_size [megabytes of elements]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../deque.h"
+
+template <size_t Bytes>
+struct Element {
+  unsigned char data[Bytes];
+
+  Element() = default;
+  explicit Element(size_t value) {
+    for (size_t i = 0; i < Bytes; ++i) {
+      data[i] = static_cast<unsigned char>(value + i);
+    }
+  }
+};
+
+static size_t sink = 0;
+
+template <typename F>
+static double best_ns_per_op(size_t ops, F&& f) {
+  double best = 1e30;
+  for (int round = 0; round < 5; ++round) {
+    auto started = std::chrono::steady_clock::now();
+    f();
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+    best = std::min(best, elapsed / static_cast<double>(ops));
+  }
+  return best;
+}
+
+template <size_t Bytes, size_t BucketSize>
+static void run(const char* block, size_t megabytes) {
+  using Value = Element<Bytes>;
+  size_t n = (megabytes << 20) / Bytes;
+  std::vector<size_t> order(n);
+  std::mt19937_64 gen(n);
+  for (size_t& index : order) {
+    index = gen() % n;
+  }
+  double push_back = best_ns_per_op(n, [&] {
+    Deque<Value, BucketSize> deque;
+    for (size_t i = 0; i < n; ++i) {
+      deque.push_back(Value(i));
+    }
+    sink += deque.size();
+  });
+  double push_front = best_ns_per_op(n, [&] {
+    Deque<Value, BucketSize> deque;
+    for (size_t i = 0; i < n; ++i) {
+      deque.push_front(Value(i));
+    }
+    sink += deque.size();
+  });
+  Deque<Value, BucketSize> deque;
+  for (size_t i = 0; i < n; ++i) {
+    deque.push_back(Value(i));
+  }
+  double random_access = best_ns_per_op(n, [&] {
+    for (size_t index : order) {
+      sink += deque[index].data[0];
+    }
+  });
+  double iterate = best_ns_per_op(n, [&] {
+    for (const Value& value : deque) {
+      sink += value.data[0];
+    }
+  });
+  double pop = best_ns_per_op(n, [&] {
+    Deque<Value, BucketSize> copy = deque;
+    for (size_t i = 0; i < n / 2; ++i) {
+      copy.pop_back();
+      copy.pop_front();
+    }
+    sink += copy.size();
+  });
+  std::printf("%6zu %6s %6zu %10.2f %10.2f %10.2f %10.2f %10.2f\n", Bytes, block, BucketSize, push_back, push_front,
+              random_access, iterate, pop);
+}
+
+template <size_t Bytes>
+static void run_both(size_t megabytes) {
+  run<Bytes, 32>("old", megabytes);
+  run<Bytes, deque_bucket_size<Element<Bytes>>()>("new", megabytes);
+}
+
+int main(int argc, char** argv) {
+  size_t megabytes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+  std::printf("%zu MB of elements, ns per element, best of 5 (pop includes copying the deque)\n", megabytes);
+  std::printf("%6s %6s %6s %10s %10s %10s %10s %10s\n", "bytes", "block", "elems", "push_back", "push_front",
+              "random", "iterate", "pop");
+  run_both<1>(megabytes);
+  run_both<8>(megabytes);
+  run_both<16>(megabytes);
+  run_both<64>(megabytes);
+  run_both<256>(megabytes);
+  return sink == 42;
+}
@@ -0,0 +1,72 @@
+// Lookup time of UnorderedMap::find one key at a time against find_batch over batches of keys,
+// for tables that fit in cache and tables that do not. Half of the looked-up keys are missing.
+//   g++ -std=c++17 -O2 find_batch.cpp -o find_batch
+//   ./find_batch [batch size]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "../unordered_map.h"
+
+static size_t sink = 0;
+
+template <typename F>
+static double best_ns_per_lookup(size_t lookups, F&& f) {
+  double best = 1e30;
+  for (int round = 0; round < 5; ++round) {
+    auto started = std::chrono::steady_clock::now();
+    f();
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+    best = std::min(best, elapsed / static_cast<double>(lookups));
+  }
+  return best;
+}
+
+int main(int argc, char** argv) {
+  size_t batch = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1024;
+  const size_t lookups = 4000000;
+  std::printf("batch %zu, ns per lookup, best of 5\n", batch);
+  std::printf("%9s %10s %12s %8s\n", "size", "find", "find_batch", "speedup");
+  for (size_t n : {size_t(1) << 14, size_t(1) << 20, size_t(1) << 23}) {
+    std::mt19937_64 gen(n);
+    UnorderedMap<uint64_t, uint64_t> map;
+    map.reserve(n);
+    std::vector<uint64_t> present(n);
+    for (uint64_t& key : present) {
+      key = gen();
+      map[key] = key;
+    }
+    std::vector<uint64_t> keys(lookups);
+    for (uint64_t& key : keys) {
+      key = gen() % 2 ? present[gen() % n] : gen();
+    }
+    using ConstIterator = UnorderedMap<uint64_t, uint64_t>::const_iterator;
+    const UnorderedMap<uint64_t, uint64_t>& table = map;
+    std::vector<ConstIterator> found(batch);
+
+    double single = best_ns_per_lookup(lookups, [&] {
+      for (size_t start = 0; start < lookups; start += batch) {
+        size_t end = std::min(start + batch, lookups);
+        for (size_t i = start; i < end; ++i) {
+          found[i - start] = table.find(keys[i]);
+        }
+        for (size_t i = 0; i < end - start; ++i) {
+          sink += found[i] != table.end() ? found[i]->second : 0;
+        }
+      }
+    });
+    double batched = best_ns_per_lookup(lookups, [&] {
+      for (size_t start = 0; start < lookups; start += batch) {
+        size_t end = std::min(start + batch, lookups);
+        table.find_batch(keys.begin() + start, keys.begin() + end, found.begin());
+        for (size_t i = 0; i < end - start; ++i) {
+          sink += found[i] != table.end() ? found[i]->second : 0;
+        }
+      }
+    });
+    std::printf("%9zu %10.1f %12.1f %7.2fx\n", n, single, batched, single / batched);
+  }
+  return sink == 42;
+}
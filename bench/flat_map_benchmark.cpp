@@ -0,0 +1,104 @@
+// Insert, lookup and erase times of the open-addressing FlatUnorderedMap against the node-based
+// UnorderedMap, with std::unordered_map as a reference, for random and sequential integer keys and short
+// string keys.
+//   g++ -std=c++17 -O2 flat_map_benchmark.cpp -o flat_map_benchmark
+//   ./flat_map_benchmark
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../string.h"
+#include "../unordered_map.h"
+
+static size_t sink = 0;
+
+template <typename F>
+static double ns_per_op(size_t ops, F&& f) {
+  auto started = std::chrono::steady_clock::now();
+  f();
+  double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+  return elapsed / static_cast<double>(ops);
+}
+
+// keys[0, n) are inserted, keys[n, 2n) are only used for failed lookups.
+template <typename Map, typename Key>
+static void run(const char* name, const std::vector<Key>& keys, size_t n) {
+  std::vector<size_t> order(n);
+  for (size_t i = 0; i < n; ++i) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), std::mt19937(n));
+  size_t repeat = std::max<size_t>(1, 4000000 / n);
+  double insert = 0;
+  double hit = 0;
+  double miss = 0;
+  double erase = 0;
+  for (size_t r = 0; r < repeat; ++r) {
+    Map map;
+    insert += ns_per_op(n, [&] {
+      for (size_t i = 0; i < n; ++i) {
+        map[keys[i]] = i;
+      }
+    });
+    hit += ns_per_op(n, [&] {
+      for (size_t i : order) {
+        sink += map.find(keys[i])->second;
+      }
+    });
+    miss += ns_per_op(n, [&] {
+      for (size_t i = n; i < 2 * n; ++i) {
+        sink += map.find(keys[i]) == map.end();
+      }
+    });
+    erase += ns_per_op(n, [&] {
+      for (size_t i : order) {
+        sink += map.erase(keys[i]);
+      }
+    });
+  }
+  double runs = static_cast<double>(repeat);
+  std::printf("%-16s %9zu %10.1f %10.1f %10.1f %10.1f\n", name, n, insert / runs, hit / runs, miss / runs,
+              erase / runs);
+}
+
+template <typename Key>
+static void run_all(const char* title, const std::vector<Key>& keys) {
+  std::printf("%s\n%-16s %9s %10s %10s %10s %10s\n", title, "map", "size", "insert ns", "hit ns", "miss ns",
+              "erase ns");
+  for (size_t n : {size_t(1000), size_t(100000), size_t(4000000)}) {
+    using Hash = std::hash<Key>;
+    run<FlatUnorderedMap<Key, size_t, Hash>>("FlatUnorderedMap", keys, n);
+    run<UnorderedMap<Key, size_t, Hash>>("UnorderedMap", keys, n);
+    run<std::unordered_map<Key, size_t, Hash>>("std", keys, n);
+  }
+}
+
+int main() {
+  const size_t max_keys = 8000000;
+  std::mt19937_64 gen(42);
+  std::vector<uint64_t> integers(max_keys);
+  for (uint64_t& key : integers) {
+    key = gen();
+  }
+  run_all("uint64_t keys", integers);
+
+  // std::hash<int> is the identity, so these keys only differ in their low bits.
+  std::vector<int> sequential(max_keys);
+  for (size_t i = 0; i < max_keys; ++i) {
+    sequential[i] = static_cast<int>(i);
+  }
+  run_all("sequential int keys", sequential);
+
+  std::vector<String> strings;
+  strings.reserve(max_keys);
+  for (size_t i = 0; i < max_keys; ++i) {
+    std::string key = "user:" + std::to_string(gen() % 1000000000000ull);
+    strings.emplace_back(key.data(), key.size());
+  }
+  run_all("String keys", strings);
+  return sink == 42;
+}
@@ -0,0 +1,78 @@
+// Time of UnorderedMap::parallel_rehash and parallel_insert_range for a sweep of thread counts,
+// next to the sequential rehash (parallel_rehash on one thread) and insert_range.
+//   g++ -std=c++17 -O2 parallel_rehash_scaling.cpp -o parallel_rehash_scaling -pthread
+//   ./parallel_rehash_scaling [nodes] [threads...]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../unordered_map.h"
+
+using Map = UnorderedMap<uint64_t, uint64_t>;
+
+template <typename F>
+static double best_ms(F&& f) {
+  double best = 1e30;
+  for (int round = 0; round < 3; ++round) {
+    best = std::min(best, f());
+  }
+  return best;
+}
+
+template <typename F>
+static double time_ms(F&& f) {
+  auto started = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+}
+
+int main(int argc, char** argv) {
+  size_t nodes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+  std::vector<size_t> thread_counts;
+  for (int i = 2; i < argc; ++i) {
+    thread_counts.push_back(std::strtoull(argv[i], nullptr, 10));
+  }
+  if (thread_counts.empty()) {
+    size_t hardware = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    for (size_t threads = 1; threads < hardware; threads *= 2) {
+      thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(hardware);
+  }
+
+  std::mt19937_64 gen(nodes);
+  std::vector<std::pair<uint64_t, uint64_t>> items(nodes);
+  for (auto& item : items) {
+    item = {gen(), 0};
+  }
+  Map filled;
+  filled.insert_range(items.begin(), items.end());
+
+  double rehash = best_ms([&] {
+    Map map = filled;
+    return time_ms([&] { map.parallel_rehash(4 * map.bucket_count(), 1); });
+  });
+  double insert = best_ms([&] {
+    Map map;
+    return time_ms([&] { map.insert_range(items.begin(), items.end()); });
+  });
+  std::printf("%zu nodes, hardware threads: %u, best of 3\n", nodes, std::thread::hardware_concurrency());
+  std::printf("%8s %12s %8s %12s %8s\n", "threads", "rehash ms", "speedup", "insert ms", "speedup");
+  std::printf("%8s %12.1f %8s %12.1f %8s\n", "seq", rehash, "1.00x", insert, "1.00x");
+  for (size_t threads : thread_counts) {
+    double parallel_rehash = best_ms([&] {
+      Map map = filled;
+      return time_ms([&] { map.parallel_rehash(4 * map.bucket_count(), threads); });
+    });
+    double parallel_insert = best_ms([&] {
+      Map map;
+      return time_ms([&] { map.parallel_insert_range(items.begin(), items.end(), threads); });
+    });
+    std::printf("%8zu %12.1f %7.2fx %12.1f %7.2fx\n", threads, parallel_rehash, rehash / parallel_rehash,
+                parallel_insert, insert / parallel_insert);
+  }
+}
@@ -0,0 +1,42 @@
+// Per-insert latency of UnorderedMap with the stop-the-world rehash (step 0) and with
+// incremental_rehash(step). Prints percentiles of the time of a single operator[] call and how
+// many calls took longer than 100us; only a handful of inserts grow the table, so the rehash
+// pauses show up in the last columns rather than in p99.
+//   g++ -std=c++17 -O2 rehash_latency.cpp -o rehash_latency
+//   ./rehash_latency [inserts]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../unordered_map.h"
+
+static double percentile(const std::vector<double>& sorted, double p) {
+  size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+  return sorted[index];
+}
+
+int main(int argc, char** argv) {
+  size_t inserts = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4000000;
+  std::vector<double> latencies(inserts);
+  std::printf("%6s %8s %8s %8s %10s %8s %10s %10s\n", "step", "p50 ns", "p99 ns", "p999 ns", "p9999 ns", ">100us",
+              "max us", "total ms");
+  for (size_t step : {0, 1, 4, 16}) {
+    UnorderedMap<uint64_t, uint64_t> map;
+    map.incremental_rehash(step);
+    auto started = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < inserts; ++i) {
+      uint64_t key = i * 0x9E3779B97F4A7C15ull;
+      auto before = std::chrono::steady_clock::now();
+      map[key] = i;
+      latencies[i] = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - before).count();
+    }
+    double total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    std::sort(latencies.begin(), latencies.end());
+    size_t slow = latencies.end() - std::upper_bound(latencies.begin(), latencies.end(), 100000.0);
+    std::printf("%6zu %8.0f %8.0f %8.0f %10.0f %8zu %10.1f %10.1f\n", step, percentile(latencies, 0.5),
+                percentile(latencies, 0.99), percentile(latencies, 0.999), percentile(latencies, 0.9999), slow,
+                latencies.back() / 1000, total);
+  }
+}
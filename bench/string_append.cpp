@@ -0,0 +1,105 @@
+// Append throughput of String and StringBuilder against std::string: single characters, short
+// views, operator+= with a String, and a StringBuilder line of mixed numbers, chars and views
+// against a similar line built with std::string and std::to_string (which prints doubles with %f).
+//   g++ -std=c++17 -O2 string_append.cpp -o string_append
+//   ./string_append [appends]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "../string.h"
+
+static size_t sink = 0;
+
+// Best of five runs, in nanoseconds per append.
+template <typename F>
+static double best_ns(size_t appends, F&& f) {
+  double best = 1e300;
+  for (int round = 0; round < 5; ++round) {
+    auto started = std::chrono::steady_clock::now();
+    sink += f();
+    double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+    best = std::min(best, elapsed / static_cast<double>(appends));
+  }
+  return best;
+}
+
+static void report(const char* name, double ours, double standard) {
+  std::printf("%-24s %10.2f %10.2f\n", name, ours, standard);
+}
+
+int main(int argc, char** argv) {
+  size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  const char word[] = "append";
+  std::printf("%zu appends\n%-24s %10s %10s\n", n, "ns per append", "String", "std");
+
+  report("push_back", best_ns(n, [&] {
+           String s;
+           for (size_t i = 0; i < n; ++i) {
+             s.push_back(static_cast<char>('a' + i % 26));
+           }
+           return s.size();
+         }),
+         best_ns(n, [&] {
+           std::string s;
+           for (size_t i = 0; i < n; ++i) {
+             s.push_back(static_cast<char>('a' + i % 26));
+           }
+           return s.size();
+         }));
+
+  report("append 6 bytes", best_ns(n, [&] {
+           String s;
+           for (size_t i = 0; i < n; ++i) {
+             s.append(word, sizeof(word) - 1);
+           }
+           return s.size();
+         }),
+         best_ns(n, [&] {
+           std::string s;
+           for (size_t i = 0; i < n; ++i) {
+             s.append(word, sizeof(word) - 1);
+           }
+           return s.size();
+         }));
+
+  String piece(word);
+  std::string std_piece(word);
+  report("operator+=", best_ns(n, [&] {
+           String s;
+           for (size_t i = 0; i < n; ++i) {
+             s += piece;
+           }
+           return s.size();
+         }),
+         best_ns(n, [&] {
+           std::string s;
+           for (size_t i = 0; i < n; ++i) {
+             s += std_piece;
+           }
+           return s.size();
+         }));
+
+  // Each iteration appends five pieces: a view, an integer, a char, a double and a char.
+  report("StringBuilder mixed", best_ns(5 * n / 10, [&] {
+           StringBuilder builder;
+           for (size_t i = 0; i < n / 10; ++i) {
+             builder << std::string_view("id=") << i << ' ' << static_cast<double>(i) * 0.5 << '\n';
+           }
+           return builder.build().size();
+         }),
+         best_ns(5 * n / 10, [&] {
+           std::string s;
+           for (size_t i = 0; i < n / 10; ++i) {
+             s += "id=";
+             s += std::to_string(i);
+             s += ' ';
+             s += std::to_string(static_cast<double>(i) * 0.5);
+             s += '\n';
+           }
+           return std::string(s).size();
+         }));
+  return sink == 42;
+}
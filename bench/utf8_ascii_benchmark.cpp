@@ -0,0 +1,102 @@
+// Throughput of the SSE2 paths of is_valid_utf8, to_lower_ascii and icompare against their scalar
+// counterparts, on generated text that resembles log lines, accented European prose, CJK prose and
+// emoji-heavy chat, in short (48 byte) and long (64 KiB) strings.
+//   g++ -std=c++17 -O2 utf8_ascii_benchmark.cpp -o utf8_ascii_benchmark
+//   ./utf8_ascii_benchmark
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../string.h"
+
+static size_t sink = 0;
+
+struct Corpus {
+  const char* name;
+  std::vector<const char*> words;
+};
+
+// Returns strings of about `length` bytes that never split a UTF-8 sequence.
+static std::vector<String> make_payloads(const Corpus& corpus, size_t length, size_t total_bytes) {
+  std::mt19937 gen(static_cast<unsigned>(length));
+  std::vector<String> payloads;
+  for (size_t bytes = 0; bytes < total_bytes; bytes += length) {
+    std::string text;
+    while (text.size() < length) {
+      text += corpus.words[gen() % corpus.words.size()];
+      text += ' ';
+    }
+    payloads.emplace_back(text.data(), text.size());
+  }
+  return payloads;
+}
+
+template <typename F>
+static double gigabytes_per_second(const std::vector<String>& payloads, F&& f) {
+  size_t bytes = 0;
+  for (const String& payload : payloads) {
+    bytes += payload.size();
+  }
+  double best = 0;
+  for (int round = 0; round < 5; ++round) {
+    auto started = std::chrono::steady_clock::now();
+    for (const String& payload : payloads) {
+      f(payload);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    best = std::max(best, static_cast<double>(bytes) / seconds / 1e9);
+  }
+  return best;
+}
+
+int main() {
+  std::vector<Corpus> corpora = {
+      {"log lines", {"2024-05-01T12:00:03Z", "INFO", "GET", "/api/v1/users/12345", "HTTP/1.1", "200",
+                     "latency_ms=12", "user-agent=Mozilla/5.0", "request_id=9f8e7d6c", "WARN", "cache", "miss"}},
+      {"european", {"Der", "Straße", "über", "Größe", "café", "naïve", "élève", "Ærø", "niño", "and", "the",
+                    "über", "São", "Paulo", "façade", "résumé", "Zürich", "ça", "va"}},
+      {"cjk", {"日本語", "の", "テキスト", "中文", "文本", "处理", "한국어", "문장", "東京", "2024年", "ok"}},
+      {"emoji chat", {"lol", "😂", "👍", "ok", "see", "you", "🎉🎉", "❤️", "tmrw", "🙂", "🚀"}},
+  };
+  std::printf("GB/s, best of 5 over 64 MiB\n");
+  std::printf("%-11s %6s %10s %10s %10s %10s %10s %10s\n", "payload", "bytes", "utf8 simd", "utf8 scal",
+              "lower simd", "lower scal", "icmp simd", "icmp scal");
+  for (const Corpus& corpus : corpora) {
+    for (size_t length : {size_t(48), size_t(65536)}) {
+      std::vector<String> payloads = make_payloads(corpus, length, size_t(64) << 20);
+      std::vector<String> upper = payloads;
+      for (String& payload : upper) {
+        to_upper_ascii(payload);
+      }
+      double utf8_simd = gigabytes_per_second(payloads, [](const String& s) {
+        sink += is_valid_utf8(s);
+      });
+      double utf8_scalar = gigabytes_per_second(payloads, [](const String& s) {
+        sink += is_valid_utf8_scalar(s.data(), s.size());
+      });
+      std::vector<String> scratch = payloads;
+      double lower_simd = gigabytes_per_second(scratch, [](const String& s) {
+        to_lower_ascii(const_cast<String&>(s));
+        sink += s[0];
+      });
+      double lower_scalar = gigabytes_per_second(scratch, [](const String& s) {
+        to_lower_ascii_scalar(s.data(), s.size());
+        sink += s[0];
+      });
+      size_t index = 0;
+      double icompare_simd = gigabytes_per_second(payloads, [&](const String& s) {
+        sink += icompare(s, upper[index++ % upper.size()]) == 0;
+      });
+      index = 0;
+      double icompare_scalar_rate = gigabytes_per_second(payloads, [&](const String& s) {
+        const String& other = upper[index++ % upper.size()];
+        sink += icompare_scalar(s.data(), s.size(), other.data(), other.size()) == 0;
+      });
+      std::printf("%-11s %6zu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", corpus.name, length, utf8_simd,
+                  utf8_scalar, lower_simd, lower_scalar, icompare_simd, icompare_scalar_rate);
+    }
+  }
+  return sink == 42;
+}
@@ -9,11 +9,34 @@ struct Node {
   size_t index;
 };
 
+// Elements per block when none is given: as many as fit in about 4 KiB, rounded down to a power
+// of two so that indexing is a shift and a mask, and never fewer than the 32 of the old fixed
+// block, which bench/deque_block_size.cpp shows is still faster to push to for large elements.
 template <typename T>
+constexpr size_t deque_bucket_size() {
+  size_t size = 32;
+  while (size * 2 * sizeof(T) <= 4096) {
+    size *= 2;
+  }
+  return size;
+}
+
+constexpr size_t deque_bucket_shift(size_t size) {
+  size_t shift = 0;
+  while ((size_t(1) << shift) < size) {
+    ++shift;
+  }
+  return shift;
+}
+
+template <typename T, size_t BucketSize = deque_bucket_size<T>()>
 class Deque {
  private:
+  static_assert(BucketSize >= 4 && (BucketSize & (BucketSize - 1)) == 0, "bucket size must be a power of two");
   mutable std::vector<T*> external_;
-  static const size_t bucket_sz_ = 32;
+  static const size_t bucket_sz_ = BucketSize;
+  static const size_t bucket_shift_ = deque_bucket_shift(BucketSize);
+  static const size_t bucket_mask_ = BucketSize - 1;
   size_t cap_;
   size_t sz_;
   Node first_;
@@ -77,6 +100,7 @@ class Deque {
   explicit Deque (size_t count, const T& v);
   explicit Deque (int sizee);
   Deque (const Deque& d);
+  Deque (Deque&& d) noexcept;
   ~Deque ();
   size_t size() const;
   size_t capacity() const;
@@ -85,7 +109,13 @@ class Deque {
   const T& at(size_t i) const;
   T& at(size_t i);
   void push_back(const T& a);
+  void push_back(T&& a);
   void push_front(const T& a);
+  void push_front(T&& a);
+  template <typename... Args>
+  T& emplace_back(Args&&... args);
+  template <typename... Args>
+  T& emplace_front(Args&&... args);
   void pop_front();
   void pop_back();
 
@@ -161,17 +191,9 @@ class Deque {
       if (diff < 0) {
         return *this -= (-diff);
       }
-      size_t shift = diff / bucket_sz_;
-      diff %= bucket_sz_;
-      auto out1 = out_;
-      out_ -= shift;
-      if (in_ + diff > *out1 + bucket_sz_ - 1) {
-        size_t temp = in_ + diff - (*out1 + bucket_sz_ - 1);
-        --out_;
-        in_ = *out_ + temp - 1;
-        return *this;
-      }
-      in_ = *out_ +  (in_ - *out1) + diff;
+      size_t offset = static_cast<size_t>(in_ - *out_) + static_cast<size_t>(diff);
+      out_ -= offset >> bucket_shift_;
+      in_ = *out_ + (offset & bucket_mask_);
       return *this;
     }
 
@@ -179,17 +201,9 @@ class Deque {
       if (diff < 0) {
         return *this += (-diff);
       }
-      size_t shift = diff / bucket_sz_;
-      diff %= bucket_sz_;
-      auto out1 = out_;
-      out_ += shift;
-      if (in_ < *out1 + diff) {
-        size_t temp = (*out1 + diff) - in_;
-        ++out_;
-        in_ = *out_ + bucket_sz_ - temp;
-      } else {
-        in_ = *out_ + (in_ - *out1) - diff;
-      }
+      size_t offset = bucket_mask_ - static_cast<size_t>(in_ - *out_) + static_cast<size_t>(diff);
+      out_ += offset >> bucket_shift_;
+      in_ = *out_ + (bucket_mask_ - (offset & bucket_mask_));
       return *this;
     }
 
@@ -212,7 +226,7 @@ class Deque {
       if (out_ == b.out_) {
         return in_ - b.in_;
       }
-      return (b.out_ - out_ - 1) * bucket_sz_ + (in_ - *out_) + (*b.out_ + bucket_sz_ - 1 - b.in_) + 1;
+      return ((b.out_ - out_ - 1) << bucket_shift_) + (in_ - *out_) + (*b.out_ + bucket_sz_ - 1 - b.in_) + 1;
     }
 
     bool operator ==(const base_iterator& b) const {
@@ -243,29 +257,33 @@ class Deque {
   using reverse_iterator = std::reverse_iterator<iterator>;
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
-  Deque& operator=(Deque d) {
-    swap_deque(d);
+  Deque& operator=(const Deque& d) {
+    Deque copy(d);
+    swap_deque(copy);
     return *this;
   }
 
-  void insert(iterator it, const T& value) {
+  Deque& operator=(Deque&& d) noexcept {
+    Deque moved(std::move(d));
+    swap_deque(moved);
+    return *this;
+  }
+
+  // The new element is built before anything moves, so args may refer to elements of the deque.
+  template <typename... Args>
+  iterator emplace(iterator it, Args&&... args) {
     auto diff = it - begin();
-    if (last_.bucket == 0 and last_.index == bucket_sz_ - 1) {
+    if ((size_t)diff == sz_) {
+      emplace_back(std::forward<Args>(args)...);
+      return begin() + diff;
+    }
+    T value(std::forward<Args>(args)...);
+    if (last_.bucket == 0 and last_.index + 2 >= bucket_sz_) {
       reserve_(std::max(2 *  cap_, (size_t)4));
     }
     it = begin() + diff;
-    if ((size_t)diff == sz_) {
-      push_back(value);
-      return;
-    }
     auto it1 = end();
-    new(it1.operator->()) T(*(it1 - 1));
-    --it1;
-    while (it1 != it) {
-      *(it1) = *(it1 - 1);
-      --it1;
-    }
-    *it = value;
+    new(it1.operator->()) T(std::move(*(it1 - 1)));
     ++sz_;
     if (last_.index == bucket_sz_ - 1) {
       --last_.bucket;
@@ -273,12 +291,32 @@ class Deque {
     } else {
       ++last_.index;
     }
+    --it1;
+    while (it1 != it) {
+      *(it1) = std::move(*(it1 - 1));
+      --it1;
+    }
+    *it = std::move(value);
+    return it;
   }
 
-  void erase(iterator it) {
+  iterator insert(iterator it, const T& value) {
+    return emplace(it, value);
+  }
+
+  iterator insert(iterator it, T&& value) {
+    return emplace(it, std::move(value));
+  }
+
+  iterator erase(iterator it) {
+    auto diff = it - begin();
+    if ((size_t)diff + 1 == sz_) {
+      pop_back();
+      return end();
+    }
     auto it1 = it;
     while (it1 < end() - 1) {
-      *(it1) = *(it1 + 1);
+      *(it1) = std::move(*(it1 + 1));
       ++it1;
     }
     (it1.operator->())->~T();
@@ -289,13 +327,20 @@ class Deque {
     } else {
       --last_.index;
     }
+    return begin() + diff;
   }
 
   iterator begin() {
+    if (cap_ == 0) {
+      return {nullptr, nullptr};
+    }
     return {&external_[first_.bucket], &external_[first_.bucket][first_.index]};
   }
 
   iterator end() {
+    if (cap_ == 0) {
+      return {nullptr, nullptr};
+    }
     if (sz_ == 0) {
       return {&external_[last_.bucket], &external_[last_.bucket][last_.index]};
     }
@@ -314,10 +359,16 @@ class Deque {
   }
 
   const_iterator cbegin() {
+    if (cap_ == 0) {
+      return {nullptr, nullptr};
+    }
     return const_iterator(&external_[first_.bucket], &external_[first_.bucket][first_.index]);
   }
 
   const_iterator cend() {
+    if (cap_ == 0) {
+      return {nullptr, nullptr};
+    }
     if (sz_ == 0) {
       return {&external_[last_.bucket], &external_[last_.bucket][last_.index]};
     }
@@ -329,10 +380,16 @@ class Deque {
 
 
   const_iterator cbegin() const {
+    if (cap_ == 0) {
+      return {nullptr, nullptr};
+    }
     return const_iterator(&external_[first_.bucket], &external_[first_.bucket][first_.index]);
   }
 
   const_iterator cend() const {
+    if (cap_ == 0) {
+      return {nullptr, nullptr};
+    }
     if (sz_ == 0) {
       return {&external_[last_.bucket], &external_[last_.bucket][last_.index]};
     }
@@ -375,8 +432,8 @@ class Deque {
   }
 };
 
-template<typename T>
-void Deque<T>::reserve_(size_t newcap) {
+template <typename T, size_t BucketSize>
+void Deque<T, BucketSize>::reserve_(size_t newcap) {
   if (cap_ == 0) {
     std::vector<T*> temp(4);
     size_t i = 0;
@@ -416,18 +473,20 @@ void Deque<T>::reserve_(size_t newcap) {
     }
     throw;
   }
+  free(external_, 0, last_.bucket);
+  free(external_, first_.bucket + 1, cap_);
   last_.bucket = shift_bottom;
   first_.bucket = newcap - shift_top - 1;
   cap_ = newcap;
   external_ = temp;
 }
-template <typename T>
-Deque<T>::~Deque() {
+template <typename T, size_t BucketSize>
+Deque<T, BucketSize>::~Deque() {
   destruct_self(0, sz_);
   free(external_, 0, cap_);
 }
-template <typename T>
-Deque<T>::Deque(): cap_(1), sz_(0), first_{0, 0}, last_{0, 0} {
+template <typename T, size_t BucketSize>
+Deque<T, BucketSize>::Deque(): cap_(1), sz_(0), first_{0, 0}, last_{0, 0} {
   try {
     external_.resize(1);
     index_alloc(external_, 0);
@@ -437,8 +496,8 @@ Deque<T>::Deque(): cap_(1), sz_(0), first_{0, 0}, last_{0, 0} {
   }
 }
 
-template <typename T>
-Deque<T>::Deque(int sizee) {
+template <typename T, size_t BucketSize>
+Deque<T, BucketSize>::Deque(int sizee) {
   try {
     if (sizee == 0) {
       external_.resize(1);
@@ -453,15 +512,15 @@ Deque<T>::Deque(int sizee) {
       last_ = {0, 0};
       return;
     }
-    external_.resize(sizee / bucket_sz_ + 1);
+    external_.resize(sizee / bucket_sz_ + 2);
     sz_ = sizee;
     cap_ = external_.size();
     if (sizee % bucket_sz_ == 0) {
       first_ = {cap_ - 2, 0};
     } else {
       first_ = {cap_ - 1, bucket_sz_ - (sizee % bucket_sz_)};
-      last_ = {0, bucket_sz_ - 1};
     }
+    last_ = {1, bucket_sz_ - 1};
     size_t i = 0;
     try {
       for (; i < external_.size(); ++i) {
@@ -492,8 +551,8 @@ Deque<T>::Deque(int sizee) {
   }
 }
 
-template <typename T>
-Deque<T>::Deque(size_t count, const T& value) {
+template <typename T, size_t BucketSize>
+Deque<T, BucketSize>::Deque(size_t count, const T& value) {
   if (count == 0) {
     cap_ = 0;
     sz_ = count;
@@ -501,12 +560,14 @@ Deque<T>::Deque(size_t count, const T& value) {
     last_ = {0, 0};
     return;
   }
-  std::vector<T*> temp(count / bucket_sz_ + 1);
+  std::vector<T*> temp(count / bucket_sz_ + 2);
   size_t i = 0, j;
   try {
     for (; i < temp.size(); ++i) {
       index_alloc(temp, i);
-      j = bucket_sz_ + 1;
+      if (i == 0) {
+        continue;
+      }
       try {
         if (i == temp.size() - 1) {
           for (j = 0; j < count % bucket_sz_; ++j) {
@@ -524,7 +585,7 @@ Deque<T>::Deque(size_t count, const T& value) {
         } else {
           destruct_range(temp[i], 0, j);
         }
-        for (size_t k = 0; k < i - 1; ++k) {
+        for (size_t k = 1; k < i; ++k) {
           destruct_range(temp[k], 0, bucket_sz_);
         }
         throw;
@@ -532,24 +593,21 @@ Deque<T>::Deque(size_t count, const T& value) {
     }
   } catch (...) {
     free(temp, 0, i + 1);
-    if (j != bucket_sz_ + 1) {
-      index_free(temp, i);
-    }
     throw;
   }
   external_ = temp;
-  cap_ = count / bucket_sz_ + 1;
+  cap_ = count / bucket_sz_ + 2;
   sz_ = count;
   if (count % bucket_sz_ == 0) {
     first_ = {cap_ - 2, 0};
   } else {
     first_ = {cap_ - 1, bucket_sz_ - (count % bucket_sz_)};
   }
-  last_ = {0, bucket_sz_ - 1};
+  last_ = {1, bucket_sz_ - 1};
 }
 
-template <typename T>
-Deque<T>::Deque(const Deque& d) {
+template <typename T, size_t BucketSize>
+Deque<T, BucketSize>::Deque(const Deque& d) {
   size_t i = 0, j = 0;
   std::vector<T*> temp(d.cap_);
   try {
@@ -598,36 +656,40 @@ Deque<T>::Deque(const Deque& d) {
   last_ = d.last_;
 }
 
-template <typename T>
-size_t Deque<T>::size() const {
+template <typename T, size_t BucketSize>
+Deque<T, BucketSize>::Deque(Deque&& d) noexcept
+    : external_(std::move(d.external_)), cap_(d.cap_), sz_(d.sz_), first_(d.first_), last_(d.last_) {
+  d.external_.clear();
+  d.cap_ = 0;
+  d.sz_ = 0;
+  d.first_ = {0, 0};
+  d.last_ = {0, 0};
+}
+
+template <typename T, size_t BucketSize>
+size_t Deque<T, BucketSize>::size() const {
   return sz_;
 }
 
-template <typename T>
-size_t Deque<T>::capacity() const {
+template <typename T, size_t BucketSize>
+size_t Deque<T, BucketSize>::capacity() const {
   return cap_ * bucket_sz_;
 }
 
-template <typename T>
-const T& Deque<T>::operator[](size_t i) const {
-  if (i + 1 > bucket_sz_ - first_.index) {
-    i -= (bucket_sz_ - first_.index);
-    return external_[first_.bucket - i / bucket_sz_ - 1][i % bucket_sz_];
-  }
-  return external_[first_.bucket][first_.index + i];
+template <typename T, size_t BucketSize>
+const T& Deque<T, BucketSize>::operator[](size_t i) const {
+  size_t position = first_.index + i;
+  return external_[first_.bucket - (position >> bucket_shift_)][position & bucket_mask_];
 }
 
-template <typename T>
-T& Deque<T>::operator[](size_t i){
-  if (i + 1 > bucket_sz_ - first_.index) {
-    i -= (bucket_sz_ - first_.index);
-    return external_[first_.bucket - i / bucket_sz_ - 1][i % bucket_sz_];
-  }
-  return external_[first_.bucket][first_.index + i];
+template <typename T, size_t BucketSize>
+T& Deque<T, BucketSize>::operator[](size_t i){
+  size_t position = first_.index + i;
+  return external_[first_.bucket - (position >> bucket_shift_)][position & bucket_mask_];
 }
 
-template <typename T>
-const T& Deque<T>::at(size_t i) const{
+template <typename T, size_t BucketSize>
+const T& Deque<T, BucketSize>::at(size_t i) const{
   if (i == sz_ or i > sz_) {
     throw std::out_of_range("exception");
   } else {
@@ -635,8 +697,8 @@ const T& Deque<T>::at(size_t i) const{
   }
 }
 
-template <typename T>
-T& Deque<T>::at(size_t i) {
+template <typename T, size_t BucketSize>
+T& Deque<T, BucketSize>::at(size_t i) {
   if (i == sz_ or i > sz_) {
     throw std::out_of_range("exception");
   } else {
@@ -644,95 +706,96 @@ T& Deque<T>::at(size_t i) {
   }
 }
 
-template <typename T>
-void Deque<T>::push_back(const T& a) {
+template <typename T, size_t BucketSize>
+void Deque<T, BucketSize>::push_back(const T& a) {
+  emplace_back(a);
+}
+
+template <typename T, size_t BucketSize>
+void Deque<T, BucketSize>::push_back(T&& a) {
+  emplace_back(std::move(a));
+}
+
+template <typename T, size_t BucketSize>
+template <typename... Args>
+T& Deque<T, BucketSize>::emplace_back(Args&&... args) {
   if (cap_ == 0) {
-    try {
-      Deque<T> temp(1, a);
-      *this = temp;
-    } catch (...) {
-      throw;
-    }
-    return;
+    Deque temp;
+    swap_deque(temp);
   }
   if (sz_ == 0) {
     try {
-      new (external_[first_.bucket] + first_.index) T(a);
+      new (external_[first_.bucket] + first_.index) T(std::forward<Args>(args)...);
       last_.index = first_.index;
       last_.bucket = first_.bucket;
       ++sz_;
     } catch(...) {
       throw;
     }
-    return;
+    return external_[first_.bucket][first_.index];
   }
-  if (last_.bucket == 0 and last_.index + 1 == bucket_sz_) {
-    T* newarr = reinterpret_cast<T*>(new uint8_t[bucket_sz_ * sizeof(T)]);
-    try {
-      new (newarr) T(a);
-    } catch(...) {
-      delete[] reinterpret_cast<uint8_t*>(newarr);
-      throw;
-    }
-    reserve_(std::max((int)cap_ * 2, 4));
+  // end() addresses the block below a full back block, so the back element never takes the
+  // last slot of block 0.
+  if (last_.bucket == 0 and last_.index + 2 >= bucket_sz_) {
+    reserve_(std::max(cap_ * 2, (size_t)4));
+  }
+  size_t temp = last_.index + 1;
+  if (last_.index + 1 == bucket_sz_) {
     --last_.bucket;
-    last_.index = 0;
-    index_free(external_, last_.bucket);
-    external_[last_.bucket] = newarr;
-    ++sz_;
-    return;
-  } else {
-    size_t temp = last_.index + 1;
-    if (last_.index + 1 == bucket_sz_) {
-      --last_.bucket;
-      temp = 0;
-    }
-    if (sz_ == 0) {
-      temp = 0;
-    }
-    try {
-      new (external_[last_.bucket] + temp) T(a);
-    } catch(...) {
-      if (temp != last_.index + 1) {
-        ++last_.bucket;
-        last_.index = bucket_sz_ - 1;
-      }
-      throw;
+    temp = 0;
+  }
+  if (sz_ == 0) {
+    temp = 0;
+  }
+  try {
+    new (external_[last_.bucket] + temp) T(std::forward<Args>(args)...);
+  } catch(...) {
+    if (temp != last_.index + 1) {
+      ++last_.bucket;
+      last_.index = bucket_sz_ - 1;
     }
-    last_.index = temp;
-    if (sz_ == 0) {
+    throw;
+  }
+  last_.index = temp;
+  if (sz_ == 0) {
 
-    }
-    ++sz_;
   }
+  ++sz_;
+  return external_[last_.bucket][last_.index];
 }
 
-template <typename T>
-void Deque<T>::push_front(const T& a) {
+template <typename T, size_t BucketSize>
+void Deque<T, BucketSize>::push_front(const T& a) {
+  emplace_front(a);
+}
+
+template <typename T, size_t BucketSize>
+void Deque<T, BucketSize>::push_front(T&& a) {
+  emplace_front(std::move(a));
+}
+
+template <typename T, size_t BucketSize>
+template <typename... Args>
+T& Deque<T, BucketSize>::emplace_front(Args&&... args) {
   if (cap_ == 0) {
-    try {
-      Deque<T> temp(1, a);
-      *this = temp;
-    } catch (...) {
-      throw;
-    }
-    return;
+    Deque temp;
+    swap_deque(temp);
   }
   if (sz_ == 0) {
     try {
-      new (external_[first_.bucket] + first_.index) T(a);
+      new (external_[first_.bucket] + first_.index) T(std::forward<Args>(args)...);
       last_.index = first_.index;
       last_.bucket = first_.bucket;
       ++sz_;
     } catch(...) {
       throw;
     }
-    return;
+    return external_[first_.bucket][first_.index];
   }
   if (first_.bucket == cap_ - 1 and first_.index == 0) {
     T* newarr = reinterpret_cast<T*>(new uint8_t[bucket_sz_ * sizeof(T)]);
     try {
-      new (newarr + bucket_sz_ - 1) T(a);
+      new (newarr + bucket_sz_ - 1) T(std::forward<Args>(args)...);
     } catch(...) {
       delete[] reinterpret_cast<uint8_t*>(newarr);
       throw;
@@ -740,10 +803,10 @@ void Deque<T>::push_front(const T& a) {
     reserve_(std::max((int)cap_ * 2, 4));
     ++first_.bucket;
     first_.index = bucket_sz_ - 1;
-    index_alloc(external_, first_.bucket);
+    index_free(external_, first_.bucket);
     external_[first_.bucket] = newarr;
     ++sz_;
-    return;
+    return external_[first_.bucket][first_.index];
   } else {
     size_t temp;
     if (first_.index == 0) {
@@ -753,7 +816,7 @@ void Deque<T>::push_front(const T& a) {
       temp = first_.index - 1;
     }
     try {
-      new (external_[first_.bucket] + temp) T(a);
+      new (external_[first_.bucket] + temp) T(std::forward<Args>(args)...);
     } catch(...) {
       if (temp == bucket_sz_ - 1) {
         --first_.bucket;
@@ -763,11 +826,12 @@ void Deque<T>::push_front(const T& a) {
     }
     first_.index = temp;
     ++sz_;
+    return external_[first_.bucket][first_.index];
   }
 }
 
-template <typename T>
-void Deque<T>::pop_back() {
+template <typename T, size_t BucketSize>
+void Deque<T, BucketSize>::pop_back() {
   (external_[last_.bucket] + last_.index)->~T();
   --sz_;
   if (last_.index == 0 and first_.bucket != last_.bucket) {
@@ -782,8 +846,8 @@ void Deque<T>::pop_back() {
   }
 }
 
-template <typename T>
-void Deque<T>::pop_front() {
+template <typename T, size_t BucketSize>
+void Deque<T, BucketSize>::pop_front() {
   (external_[first_.bucket] + first_.index)->~T();
   --sz_;
   if (first_.index == bucket_sz_ - 1 and first_.bucket != last_.bucket) {
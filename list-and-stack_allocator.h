@@ -325,6 +325,9 @@ class StackStorage {
   StackStorage() = default;
   ~StackStorage() = default;
   StackStorage(const StackStorage& storage) = delete;
+
+  void reset() { occupied_ = 0; }
+  size_t occupied() const { return occupied_; }
 };
 
 template <typename T, size_t N>
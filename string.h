@@ -1,87 +1,225 @@
 #include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
-class String {
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+template <typename Alloc = std::allocator<char>>
+class BasicString {
   private:
+  using AllocTraits = std::allocator_traits<Alloc>;
   size_t capacity_;
   size_t size_;
   char* data_;
+  Alloc alloc_;
+  static constexpr size_t min_capacity_ = 16;
+  char* allocate(size_t size) {
+    return size == 0 ? nullptr : AllocTraits::allocate(alloc_, size);
+  }
+  void deallocate() {
+    if (data_) {
+      AllocTraits::deallocate(alloc_, data_, capacity_);
+    }
+  }
   void reallocate(size_t size) {
-    char *new_data = new char[size];
-    capacity_ = size;
+    char *new_data = allocate(size);
     std::copy(data_, data_ + size_, new_data);
-    delete[] data_;
+    deallocate();
+    capacity_ = size;
     data_ = new_data;
   }
-  void swap_str(String& str) {
+  void grow(size_t required) {
+    if (required <= capacity_) {
+      return;
+    }
+    reallocate(std::max(required, std::max(2 * capacity_, min_capacity_)));
+  }
+  void assign_chars(const char* str, size_t count) {
+    if (count > capacity_) {
+      char* new_data = AllocTraits::allocate(alloc_, count);
+      deallocate();
+      data_ = new_data;
+      capacity_ = count;
+    }
+    std::copy(str, str + count, data_);
+    size_ = count;
+  }
+  void steal(BasicString& str) {
+    deallocate();
+    data_ = str.data_;
+    capacity_ = str.capacity_;
+    size_ = str.size_;
+    str.data_ = nullptr;
+    str.capacity_ = 0;
+    str.size_ = 0;
+  }
+  // Buffers can only change hands when the allocators are equal or travel with them; otherwise
+  // the characters are copied and every string keeps its own allocator.
+  void swap_str(BasicString& str) {
+    if constexpr (!AllocTraits::propagate_on_container_swap::value) {
+      if (alloc_ != str.alloc_) {
+        BasicString temp(str, alloc_);
+        str.assign_chars(data_, size_);
+        swap_str(temp);
+        return;
+      }
+    } else {
+      using std::swap;
+      swap(alloc_, str.alloc_);
+    }
     std::swap(data_, str.data_);
     std::swap(capacity_, str.capacity_);
     std::swap(size_, str.size_);
   }
   public:
-  String() : capacity_(0), size_(0), data_(new char[0]) {}
-  String(const String& str) : capacity_(str.size_), size_(str.size_), data_(new char[capacity_]) {
+  using allocator_type = Alloc;
+
+  BasicString() : capacity_(0), size_(0), data_(nullptr) {}
+  explicit BasicString(const Alloc& alloc) : capacity_(0), size_(0), data_(nullptr), alloc_(alloc) {}
+  BasicString(const BasicString& str)
+      : capacity_(str.size_), size_(str.size_), data_(nullptr),
+        alloc_(AllocTraits::select_on_container_copy_construction(str.alloc_)) {
+    data_ = allocate(capacity_);
     std::copy(str.data_, str.data_ + size_, data_);
   }
-  String(size_t size, char chr): capacity_(size), size_(size), data_(new char[capacity_]) {
+  BasicString(const BasicString& str, const Alloc& alloc)
+      : capacity_(str.size_), size_(str.size_), data_(nullptr), alloc_(alloc) {
+    data_ = allocate(capacity_);
+    std::copy(str.data_, str.data_ + size_, data_);
+  }
+  BasicString(size_t size, char chr, const Alloc& alloc = Alloc())
+      : capacity_(size), size_(size), data_(nullptr), alloc_(alloc) {
+    data_ = allocate(capacity_);
     std::fill(data_, data_ + size, chr);
   }
-  String(const char* str): capacity_(strlen(str)), size_(capacity_), data_(new char[capacity_]) {
-    std::copy(str, str + size_ + 1, data_);
+  BasicString(const char* str, const Alloc& alloc = Alloc())
+      : capacity_(strlen(str)), size_(capacity_), data_(nullptr), alloc_(alloc) {
+    data_ = allocate(capacity_);
+    std::copy(str, str + size_, data_);
+  }
+  BasicString(const char* str, size_t count, const Alloc& alloc = Alloc())
+      : capacity_(count), size_(count), data_(nullptr), alloc_(alloc) {
+    data_ = allocate(capacity_);
+    std::copy(str, str + count, data_);
   }
-  ~String() { delete[] data_; }
-  String& operator=(String str) {
-    swap_str(str);
+  BasicString(BasicString&& str) noexcept
+      : capacity_(str.capacity_), size_(str.size_), data_(str.data_), alloc_(std::move(str.alloc_)) {
+    str.capacity_ = 0;
+    str.size_ = 0;
+    str.data_ = nullptr;
+  }
+  ~BasicString() { deallocate(); }
+  BasicString& operator=(const BasicString& str) {
+    if (this == &str) {
+      return *this;
+    }
+    if constexpr (AllocTraits::propagate_on_container_copy_assignment::value) {
+      if (alloc_ != str.alloc_) {
+        deallocate();
+        data_ = nullptr;
+        capacity_ = 0;
+      }
+      alloc_ = str.alloc_;
+    }
+    assign_chars(str.data_, str.size_);
     return *this;
   }
+  BasicString& operator=(BasicString&& str) noexcept(AllocTraits::propagate_on_container_move_assignment::value ||
+                                                     AllocTraits::is_always_equal::value) {
+    if (this == &str) {
+      return *this;
+    }
+    if constexpr (AllocTraits::propagate_on_container_move_assignment::value) {
+      steal(str);
+      alloc_ = std::move(str.alloc_);
+    } else {
+      if (alloc_ == str.alloc_) {
+        steal(str);
+      } else {
+        assign_chars(str.data_, str.size_);
+      }
+    }
+    return *this;
+  }
+  void swap(BasicString& str) { swap_str(str); }
+  friend void swap(BasicString& a, BasicString& b) { a.swap_str(b); }
+  Alloc get_allocator() const { return alloc_; }
   size_t length() const { return size_; }
   size_t capacity() const { return capacity_; }
   size_t size() const { return size_; }
   char& operator[](size_t i) { return data_[i]; }
   const char& operator[](size_t i) const { return data_[i]; }
   void pop_back() { --size_; }
+  void reserve(size_t count) {
+    if (count > capacity_) {
+      reallocate(count);
+    }
+  }
   void push_back(char a) {
-    if (size_ + 1 > capacity_) {
-      reallocate(2 * capacity_);
+    if (size_ == capacity_) {
+      grow(size_ + 1);
     }
     data_[size_++] = a;
   }
+  BasicString& append(const char* str, size_t count) {
+    if (size_ + count > capacity_) {
+      // str may point into data_, so it is copied before the old buffer is freed.
+      size_t new_capacity = std::max(size_ + count, std::max(2 * capacity_, min_capacity_));
+      char* new_data = allocate(new_capacity);
+      std::copy(data_, data_ + size_, new_data);
+      std::copy(str, str + count, new_data + size_);
+      deallocate();
+      capacity_ = new_capacity;
+      data_ = new_data;
+      size_ += count;
+      return *this;
+    }
+    std::copy(str, str + count, data_ + size_);
+    size_ += count;
+    return *this;
+  }
   const char& front() const { return data_[0]; }
   const char& back() const { return data_[size_ - 1]; }
   char& front() { return data_[0]; }
   char& back() { return data_[size_ - 1]; }
-  String& operator+=(char a) {
+  BasicString& operator+=(char a) {
     push_back(a);
     return *this;
   }
-  String& operator+=(const String& str) {
-    if (size_ + str.size_ > capacity_) {
-      reallocate(size_ + str.size_);
-      std::copy(str.data_, str.data_ + str.size_, data_ + size_);
-      size_ += str.size_;
-    }
-    else {
-      std::copy(str.data_, str.data_ + str.size_, data_ + size_);
-      size_ += str.size_;
-    }
+  BasicString& operator+=(const BasicString& str) {
+    grow(size_ + str.size_);
+    std::copy(str.data_, str.data_ + str.size_, data_ + size_);
+    size_ += str.size_;
     return *this;
   }
-  String substr(size_t start, size_t count) const {
-    String temp(count, '.');
-    std::copy(data_ + start, data_ + start + count, temp.data_);
-    return temp;
+  BasicString substr(size_t start, size_t count) const {
+    return BasicString(data_ + start, count, alloc_);
   }
-  size_t find(const String& str) const {
+  size_t find(const BasicString& str) const {
+    if (str.size_ > size_) {
+      return length();
+    }
     for (size_t i = 0; i <= size_ - str.size_; ++i) {
-      bool flag = memcmp(str.data_, data_ + i, str.size());
-      if (!flag) return i;
+      if (std::equal(str.data_, str.data_ + str.size_, data_ + i)) return i;
     }
     return length();
   }
-  size_t rfind(const String& str) const {
+  size_t rfind(const BasicString& str) const {
+    if (str.size_ > size_) {
+      return length();
+    }
     for (size_t i = size_ - str.size_ + 1; i > 0; --i) {
-      bool flag = memcmp(str.data_, data_ + i - 1, str.size());
-      if (!flag) return --i;
+      if (std::equal(str.data_, str.data_ + str.size_, data_ + i - 1)) return --i;
     }
     return length();
   }
@@ -91,52 +229,1029 @@ class String {
     reallocate(size_);
   }
   char* data() const { return data_; };
+  std::string_view view() const { return std::string_view(data_, size_); }
+
+  friend bool operator<(const BasicString& a, const BasicString& b) {
+    return a.size() < b.size() || ((a.size() == b.size()) && std::lexicographical_compare(
+        a.data(), a.data() + a.size(), b.data(), b.data() + b.size(),
+        [](char x, char y) { return static_cast<unsigned char>(x) < static_cast<unsigned char>(y); }));
+  }
+  friend bool operator==(const BasicString& a, const BasicString& b) {
+    if (a.size() != b.size())
+      return false;
+    return std::equal(a.data(), a.data() + a.size(), b.data());
+  }
+  friend bool operator>=(const BasicString& a, const BasicString& b) {
+    return !(a < b);
+  }
+  friend bool operator<=(const BasicString& a, const BasicString& b) {
+    return !(b < a);
+  }
+  friend bool operator>(const BasicString& a, const BasicString& b) {
+    return (b < a);
+  }
+  friend bool operator!=(const BasicString& a, const BasicString& b) {
+    return !(a == b);
+  }
+  friend BasicString operator+(BasicString a, const BasicString& b) {
+    a += b;
+    return a;
+  }
+  friend BasicString operator+(BasicString a, char b) {
+    a.push_back(b);
+    return a;
+  }
+  friend BasicString operator+(char a, const BasicString& b) {
+    BasicString temp(b.alloc_);
+    temp.reserve(b.size() + 1);
+    temp += a;
+    temp += b;
+    return temp;
+  }
+  friend std::ostream& operator<<(std::ostream &out, const BasicString& str) {
+    for (size_t i = 0; i < str.length(); ++i) {
+      out << str[i];
+    }
+    return out;
+  }
+  friend std::istream& operator>>(std::istream &in, BasicString& str) {
+    char temp;
+    while (in.get(temp) && !std::isspace(temp)) {
+      str.push_back(temp);
+    }
+    return in;
+  }
 };
-bool operator<(const String& a, const String& b) {
-  return a.size() < b.size() || ((a.size() == b.size()) && memcmp(a.data(), b.data(), a.size()) < 0);
+
+using String = BasicString<>;
+
+size_t hash_bytes(const char* data, size_t size) {
+  const uint64_t mul = 0x9E3779B97F4A7C15ull;
+  uint64_t hash = 0xCBF29CE484222325ull ^ (size * mul);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * mul;
+    hash ^= hash >> 32;
+  }
+  uint64_t tail = 0;
+  if (i < size) {
+    memcpy(&tail, data + i, size - i);
+  }
+  hash = (hash ^ tail) * mul;
+  hash ^= hash >> 29;
+  return static_cast<size_t>(hash);
 }
-bool operator==(const String& a, const String& b) {
-  if (a.size() != b.size())
-    return false;
-  return !memcmp(a.data(), b.data(), a.size());
+
+struct StringHash {
+  using is_transparent = void;
+  template <typename Alloc>
+  size_t operator()(const BasicString<Alloc>& str) const { return hash_bytes(str.data(), str.size()); }
+  size_t operator()(std::string_view str) const { return hash_bytes(str.data(), str.size()); }
+  size_t operator()(const char* str) const { return hash_bytes(str, strlen(str)); }
+};
+
+struct StringEqual {
+  using is_transparent = void;
+
+  template <typename Alloc>
+  static std::string_view as_view(const BasicString<Alloc>& str) { return str.view(); }
+  static std::string_view as_view(std::string_view str) { return str; }
+
+  template <typename A, typename B>
+  bool operator()(const A& a, const B& b) const { return as_view(a) == as_view(b); }
+};
+
+template <typename Alloc>
+struct std::hash<BasicString<Alloc>> : StringHash {};
+
+class StringBuilder {
+ private:
+  String buffer_;
+
+ public:
+  StringBuilder() = default;
+  explicit StringBuilder(size_t capacity) {
+    buffer_.reserve(capacity);
+  }
+
+  size_t size() const { return buffer_.size(); }
+  size_t capacity() const { return buffer_.capacity(); }
+  bool empty() const { return buffer_.empty(); }
+  void reserve(size_t count) { buffer_.reserve(count); }
+  void clear() { buffer_.clear(); }
+
+  StringBuilder& append(char chr) {
+    buffer_.push_back(chr);
+    return *this;
+  }
+  StringBuilder& append(size_t count, char chr) {
+    buffer_.reserve(buffer_.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+      buffer_.push_back(chr);
+    }
+    return *this;
+  }
+  StringBuilder& append(const char* str) {
+    buffer_.append(str, strlen(str));
+    return *this;
+  }
+  StringBuilder& append(std::string_view view) {
+    buffer_.append(view.data(), view.size());
+    return *this;
+  }
+  template <typename Alloc>
+  StringBuilder& append(const BasicString<Alloc>& str) {
+    buffer_.append(str.data(), str.size());
+    return *this;
+  }
+  template <typename Number,
+            typename = std::enable_if_t<std::is_arithmetic_v<Number> && !std::is_same_v<Number, char> &&
+                                        !std::is_same_v<Number, bool>>>
+  StringBuilder& append(Number number) {
+    char temp[64];
+    auto result = std::to_chars(temp, temp + sizeof(temp), number);
+    buffer_.append(temp, result.ptr - temp);
+    return *this;
+  }
+  StringBuilder& append(bool value) {
+    return value ? append(std::string_view("true")) : append(std::string_view("false"));
+  }
+
+  template <typename T>
+  StringBuilder& operator<<(const T& value) {
+    return append(value);
+  }
+
+  std::string_view view() const { return std::string_view(buffer_.data(), buffer_.size()); }
+
+  String build() const {
+    return String(buffer_.data(), buffer_.size());
+  }
+  String release() {
+    String result = std::move(buffer_);
+    buffer_ = String();
+    return result;
+  }
+};
+
+class Rope {
+ private:
+  struct Node {
+    String chunk;
+    size_t length;
+    uint32_t priority;
+    Node* left = nullptr;
+    Node* right = nullptr;
+    Node(String&& str, uint32_t prio): chunk(std::move(str)), length(chunk.size()), priority(prio) {}
+  };
+
+  static constexpr size_t max_chunk_ = 1024;
+  uint32_t seed_ = 2463534242u;
+  Node* root_ = nullptr;
+
+  uint32_t next_priority() {
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+    return seed_;
+  }
+
+  static size_t length(const Node* node) { return node ? node->length : 0; }
+
+  static void update(Node* node) {
+    node->length = length(node->left) + node->chunk.size() + length(node->right);
+  }
+
+  static void destroy(Node* node) {
+    while (node) {
+      destroy(node->right);
+      Node* left = node->left;
+      delete node;
+      node = left;
+    }
+  }
+
+  static Node* clone(const Node* node) {
+    if (!node) {
+      return nullptr;
+    }
+    Node* copy = new Node(String(node->chunk), node->priority);
+    try {
+      copy->left = clone(node->left);
+      copy->right = clone(node->right);
+    } catch (...) {
+      destroy(copy);
+      throw;
+    }
+    copy->length = node->length;
+    return copy;
+  }
+
+  static Node* merge(Node* left, Node* right) {
+    if (!left) {
+      return right;
+    }
+    if (!right) {
+      return left;
+    }
+    if (left->priority >= right->priority) {
+      left->right = merge(left->right, right);
+      update(left);
+      return left;
+    }
+    right->left = merge(left, right->left);
+    update(right);
+    return right;
+  }
+
+  static void split(Node* node, size_t pos, Node*& left, Node*& right) {
+    if (!node) {
+      left = right = nullptr;
+      return;
+    }
+    size_t left_len = length(node->left);
+    size_t chunk_len = node->chunk.size();
+    if (pos <= left_len) {
+      split(node->left, pos, left, node->left);
+      update(node);
+      right = node;
+    } else if (pos >= left_len + chunk_len) {
+      split(node->right, pos - left_len - chunk_len, node->right, right);
+      update(node);
+      left = node;
+    } else {
+      size_t offset = pos - left_len;
+      Node* tail = new Node(node->chunk.substr(offset, chunk_len - offset), node->priority);
+      node->chunk = node->chunk.substr(0, offset);
+      tail->right = node->right;
+      node->right = nullptr;
+      update(tail);
+      update(node);
+      left = node;
+      right = tail;
+    }
+  }
+
+  static bool append_to_last(Node* node, const char* str, size_t count) {
+    if (!node) {
+      return false;
+    }
+    if (node->right) {
+      if (!append_to_last(node->right, str, count)) {
+        return false;
+      }
+    } else if (node->chunk.size() + count <= max_chunk_) {
+      node->chunk.append(str, count);
+    } else {
+      return false;
+    }
+    node->length += count;
+    return true;
+  }
+
+  Node* build(const char* str, size_t count) {
+    Node* result = nullptr;
+    for (size_t i = 0; i < count; i += max_chunk_) {
+      size_t piece = std::min(max_chunk_, count - i);
+      result = merge(result, new Node(String(str + i, piece), next_priority()));
+    }
+    return result;
+  }
+
+  static void collect(const Node* node, size_t pos, size_t count, Rope& out) {
+    while (node and count > 0) {
+      size_t left_len = length(node->left);
+      size_t chunk_len = node->chunk.size();
+      if (pos < left_len) {
+        size_t taken = std::min(count, left_len - pos);
+        collect(node->left, pos, taken, out);
+        pos = left_len;
+        count -= taken;
+        continue;
+      }
+      if (pos < left_len + chunk_len) {
+        size_t offset = pos - left_len;
+        size_t taken = std::min(count, chunk_len - offset);
+        out.append_chars(node->chunk.data() + offset, taken);
+        pos += taken;
+        count -= taken;
+      }
+      pos -= left_len + chunk_len;
+      node = node->right;
+    }
+  }
+
+  void append_chars(const char* str, size_t count) {
+    if (count == 0 or append_to_last(root_, str, count)) {
+      return;
+    }
+    root_ = merge(root_, build(str, count));
+  }
+
+ public:
+  class chunk_iterator {
+   public:
+    using difference_type = ptrdiff_t;
+    using value_type = String;
+    using pointer = const String*;
+    using reference = const String&;
+    using iterator_category = std::forward_iterator_tag;
+
+   private:
+    std::vector<const Node*> stack_;
+
+    void descend(const Node* node) {
+      while (node) {
+        stack_.push_back(node);
+        node = node->left;
+      }
+    }
+
+   public:
+    chunk_iterator() = default;
+    explicit chunk_iterator(const Node* root) { descend(root); }
+
+    reference operator*() const { return stack_.back()->chunk; }
+    pointer operator->() const { return &stack_.back()->chunk; }
+
+    chunk_iterator& operator++() {
+      const Node* node = stack_.back();
+      stack_.pop_back();
+      descend(node->right);
+      return *this;
+    }
+    chunk_iterator operator++(int) {
+      auto temp = *this;
+      ++*this;
+      return temp;
+    }
+
+    bool operator==(const chunk_iterator& other) const {
+      if (stack_.empty() or other.stack_.empty()) {
+        return stack_.empty() == other.stack_.empty();
+      }
+      return stack_.back() == other.stack_.back();
+    }
+    bool operator!=(const chunk_iterator& other) const { return !(*this == other); }
+  };
+
+  Rope() = default;
+  Rope(const String& str) : root_(build(str.data(), str.size())) {}
+  Rope(const char* str) : root_(build(str, strlen(str))) {}
+  Rope(const Rope& other) : seed_(other.seed_), root_(clone(other.root_)) {}
+  Rope(Rope&& other) noexcept : seed_(other.seed_), root_(other.root_) { other.root_ = nullptr; }
+  ~Rope() { destroy(root_); }
+
+  Rope& operator=(Rope other) {
+    std::swap(root_, other.root_);
+    std::swap(seed_, other.seed_);
+    return *this;
+  }
+
+  size_t size() const { return length(root_); }
+  size_t length() const { return length(root_); }
+  bool empty() const { return root_ == nullptr; }
+  void clear() {
+    destroy(root_);
+    root_ = nullptr;
+  }
+
+  char operator[](size_t i) const {
+    const Node* node = root_;
+    while (true) {
+      size_t left_len = length(node->left);
+      if (i < left_len) {
+        node = node->left;
+      } else if (i < left_len + node->chunk.size()) {
+        return node->chunk[i - left_len];
+      } else {
+        i -= left_len + node->chunk.size();
+        node = node->right;
+      }
+    }
+  }
+
+  char at(size_t i) const {
+    if (i >= size()) {
+      throw std::out_of_range("out of range");
+    }
+    return (*this)[i];
+  }
+
+  Rope& operator+=(Rope&& other) {
+    root_ = merge(root_, other.root_);
+    other.root_ = nullptr;
+    return *this;
+  }
+  Rope& operator+=(const Rope& other) {
+    return *this += Rope(other);
+  }
+  Rope& operator+=(const String& str) {
+    append_chars(str.data(), str.size());
+    return *this;
+  }
+  Rope& operator+=(char chr) {
+    append_chars(&chr, 1);
+    return *this;
+  }
+
+  Rope split(size_t pos) {
+    Rope tail;
+    split(root_, std::min(pos, size()), root_, tail.root_);
+    return tail;
+  }
+
+  void insert(size_t pos, Rope&& other) {
+    Rope tail = split(pos);
+    *this += std::move(other);
+    *this += std::move(tail);
+  }
+
+  void insert(size_t pos, const String& str) {
+    Rope tail = split(pos);
+    *this += str;
+    *this += std::move(tail);
+  }
+
+  void erase(size_t pos, size_t count) {
+    Rope middle = split(pos);
+    Rope tail = middle.split(count);
+    *this += std::move(tail);
+  }
+
+  Rope substr(size_t pos, size_t count) const {
+    Rope result;
+    collect(root_, pos, std::min(count, size() - std::min(pos, size())), result);
+    return result;
+  }
+
+  chunk_iterator chunks_begin() const { return chunk_iterator(root_); }
+  chunk_iterator chunks_end() const { return chunk_iterator(); }
+
+  String to_string() const {
+    String result;
+    result.reserve(size());
+    for (auto it = chunks_begin(); it != chunks_end(); ++it) {
+      result += *it;
+    }
+    return result;
+  }
+};
+
+Rope operator+(Rope a, Rope b) {
+  a += std::move(b);
+  return a;
 }
-bool operator>=(const String& a, const String& b) {
-  return !(a < b);
+
+std::ostream& operator<<(std::ostream& out, const Rope& rope) {
+  for (auto it = rope.chunks_begin(); it != rope.chunks_end(); ++it) {
+    out.write(it->data(), it->size());
+  }
+  return out;
 }
-bool operator<=(const String& a, const String& b) {
-  return !(b < a);
+
+class StringPool;
+
+class InternedString {
+  friend class StringPool;
+
+ private:
+  struct Entry {
+    size_t hash;
+    size_t size;
+    uint32_t id;
+    const char* data;
+  };
+  const Entry* entry_ = nullptr;
+
+  explicit InternedString(const Entry* entry): entry_(entry) {}
+
+ public:
+  InternedString() = default;
+
+  size_t hash() const { return entry_->hash; }
+  uint32_t id() const { return entry_->id; }
+  size_t size() const { return entry_->size; }
+  const char* data() const { return entry_->data; }
+  std::string_view view() const { return std::string_view(entry_->data, entry_->size); }
+  String str() const { return String(entry_->data, entry_->size); }
+  explicit operator bool() const { return entry_ != nullptr; }
+
+  bool operator==(const InternedString& other) const { return entry_ == other.entry_; }
+  bool operator!=(const InternedString& other) const { return entry_ != other.entry_; }
+  bool operator<(const InternedString& other) const { return entry_ < other.entry_; }
+};
+
+template <>
+struct std::hash<InternedString> {
+  size_t operator()(const InternedString& str) const { return str.hash(); }
+};
+
+class StringPool {
+ private:
+  using Entry = InternedString::Entry;
+
+  struct Table {
+    size_t mask;
+    std::unique_ptr<std::atomic<const Entry*>[]> slots;
+    explicit Table(size_t capacity): mask(capacity - 1), slots(new std::atomic<const Entry*>[capacity]) {
+      for (size_t i = 0; i < capacity; ++i) {
+        slots[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  static constexpr size_t block_size_ = 64 * 1024;
+  static constexpr size_t default_capacity_ = 64;
+
+  std::atomic<Table*> table_;
+  std::vector<std::unique_ptr<Table>> tables_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* block_pos_ = nullptr;
+  size_t block_left_ = 0;
+  size_t size_ = 0;
+  std::mutex mutex_;
+
+  char* arena_allocate(size_t bytes) {
+    bytes = (bytes + alignof(Entry) - 1) & ~(alignof(Entry) - 1);
+    if (bytes > block_left_) {
+      size_t block = std::max(block_size_, bytes);
+      blocks_.emplace_back(new char[block]);
+      block_pos_ = blocks_.back().get();
+      block_left_ = block;
+    }
+    char* result = block_pos_;
+    block_pos_ += bytes;
+    block_left_ -= bytes;
+    return result;
+  }
+
+  static const Entry* probe(const Table* table, size_t hash, const char* data, size_t size) {
+    for (size_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+      const Entry* entry = table->slots[i].load(std::memory_order_acquire);
+      if (!entry) {
+        return nullptr;
+      }
+      if (entry->hash == hash and entry->size == size and !memcmp(entry->data, data, size)) {
+        return entry;
+      }
+    }
+  }
+
+  static void place(Table* table, const Entry* entry) {
+    size_t i = entry->hash & table->mask;
+    while (table->slots[i].load(std::memory_order_relaxed)) {
+      i = (i + 1) & table->mask;
+    }
+    table->slots[i].store(entry, std::memory_order_release);
+  }
+
+  void grow() {
+    Table* old_table = table_.load(std::memory_order_relaxed);
+    size_t capacity = 2 * (old_table->mask + 1);
+    tables_.emplace_back(new Table(capacity));
+    Table* new_table = tables_.back().get();
+    for (size_t i = 0; i <= old_table->mask; ++i) {
+      const Entry* entry = old_table->slots[i].load(std::memory_order_relaxed);
+      if (entry) {
+        place(new_table, entry);
+      }
+    }
+    table_.store(new_table, std::memory_order_release);
+  }
+
+ public:
+  StringPool() {
+    tables_.emplace_back(new Table(default_capacity_));
+    table_.store(tables_.back().get(), std::memory_order_relaxed);
+  }
+  StringPool(const StringPool&) = delete;
+  StringPool& operator=(const StringPool&) = delete;
+
+  InternedString find(std::string_view str) const {
+    const Table* table = table_.load(std::memory_order_acquire);
+    return InternedString(probe(table, hash_bytes(str.data(), str.size()), str.data(), str.size()));
+  }
+  template <typename Alloc>
+  InternedString find(const BasicString<Alloc>& str) const {
+    return find(std::string_view(str.data(), str.size()));
+  }
+
+  InternedString intern(std::string_view str) {
+    size_t hash = hash_bytes(str.data(), str.size());
+    const Entry* entry = probe(table_.load(std::memory_order_acquire), hash, str.data(), str.size());
+    if (entry) {
+      return InternedString(entry);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Table* table = table_.load(std::memory_order_relaxed);
+    entry = probe(table, hash, str.data(), str.size());
+    if (entry) {
+      return InternedString(entry);
+    }
+    if (2 * (size_ + 1) > table->mask + 1) {
+      grow();
+      table = table_.load(std::memory_order_relaxed);
+    }
+    char* memory = arena_allocate(sizeof(Entry) + str.size());
+    char* data = memory + sizeof(Entry);
+    std::copy(str.data(), str.data() + str.size(), data);
+    Entry* created = new (memory) Entry{hash, str.size(), static_cast<uint32_t>(size_), data};
+    place(table, created);
+    ++size_;
+    return InternedString(created);
+  }
+  template <typename Alloc>
+  InternedString intern(const BasicString<Alloc>& str) {
+    return intern(std::string_view(str.data(), str.size()));
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+  }
+};
+
+size_t utf8_sequence_length(const unsigned char* data, size_t size) {
+  unsigned char lead = data[0];
+  if (lead < 0x80) {
+    return 1;
+  }
+  size_t length;
+  unsigned char min_second = 0x80;
+  unsigned char max_second = 0xBF;
+  if (lead >= 0xC2 and lead <= 0xDF) {
+    length = 2;
+  } else if (lead >= 0xE0 and lead <= 0xEF) {
+    length = 3;
+    if (lead == 0xE0) {
+      min_second = 0xA0;
+    } else if (lead == 0xED) {
+      max_second = 0x9F;
+    }
+  } else if (lead >= 0xF0 and lead <= 0xF4) {
+    length = 4;
+    if (lead == 0xF0) {
+      min_second = 0x90;
+    } else if (lead == 0xF4) {
+      max_second = 0x8F;
+    }
+  } else {
+    return 0;
+  }
+  if (length > size or data[1] < min_second or data[1] > max_second) {
+    return 0;
+  }
+  for (size_t i = 2; i < length; ++i) {
+    if ((data[i] & 0xC0) != 0x80) {
+      return 0;
+    }
+  }
+  return length;
 }
-bool operator>(const String& a, const String& b) {
-  return (b < a);
+
+bool is_valid_utf8_scalar(const char* data, size_t size) {
+  auto bytes = reinterpret_cast<const unsigned char*>(data);
+  size_t i = 0;
+  while (i < size) {
+    size_t length = utf8_sequence_length(bytes + i, size - i);
+    if (length == 0) {
+      return false;
+    }
+    i += length;
+  }
+  return true;
 }
-bool operator!=(const String& a, const String& b) {
-  return !(a == b);
+
+bool is_valid_utf8(const char* data, size_t size) {
+#ifdef __SSE2__
+  auto bytes = reinterpret_cast<const unsigned char*>(data);
+  size_t i = 0;
+  while (i + 16 <= size) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+    unsigned non_ascii = static_cast<unsigned>(_mm_movemask_epi8(block));
+    if (non_ascii == 0) {
+      i += 16;
+      continue;
+    }
+    // Skip the ASCII prefix of the block and decode only the run of multi-byte sequences.
+    i += __builtin_ctz(non_ascii);
+    do {
+      size_t length = utf8_sequence_length(bytes + i, size - i);
+      if (length == 0) {
+        return false;
+      }
+      i += length;
+    } while (i < size and bytes[i] >= 0x80);
+  }
+  return is_valid_utf8_scalar(data + i, size - i);
+#else
+  return is_valid_utf8_scalar(data, size);
+#endif
 }
-String operator+(String a, const String& b) {
-  a += b;
-  return a;
+
+template <typename Alloc>
+bool is_valid_utf8(const BasicString<Alloc>& str) {
+  return is_valid_utf8(str.data(), str.size());
 }
-String operator+(String a, char b) {
-  a.push_back(b);
-  return a;
+
+char to_lower_ascii(char chr) {
+  return (chr >= 'A' and chr <= 'Z') ? static_cast<char>(chr + ('a' - 'A')) : chr;
 }
-String operator+(char a, const String& b) {
-  String temp;
-  temp += a;
-  temp += b;
-  return temp;
+
+char to_upper_ascii(char chr) {
+  return (chr >= 'a' and chr <= 'z') ? static_cast<char>(chr - ('a' - 'A')) : chr;
 }
-std::ostream& operator<<(std::ostream &out, const String& str) {
-  for (size_t i = 0; i < str.length(); ++i) {
-    out << str[i];
+
+#ifdef __SSE2__
+__m128i to_lower_ascii(__m128i block) {
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('A' - 1)),
+                                _mm_cmplt_epi8(block, _mm_set1_epi8('Z' + 1)));
+  return _mm_add_epi8(block, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+__m128i to_upper_ascii(__m128i block) {
+  __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(block, _mm_set1_epi8('z' + 1)));
+  return _mm_sub_epi8(block, _mm_and_si128(lower, _mm_set1_epi8('a' - 'A')));
+}
+#endif
+
+void to_lower_ascii_scalar(char* data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = to_lower_ascii(data[i]);
   }
-  return out;
 }
-std::istream& operator>>(std::istream &in, String& str) {
-  char temp;
-  while (in.get(temp) && !std::isspace(temp)) {
-    str.push_back(temp);
+
+void to_upper_ascii_scalar(char* data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = to_upper_ascii(data[i]);
+  }
+}
+
+template <typename Alloc>
+void to_lower_ascii(BasicString<Alloc>& str) {
+  char* data = str.data();
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= str.size(); i += 16) {
+    auto ptr = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(ptr, to_lower_ascii(_mm_loadu_si128(ptr)));
+  }
+#endif
+  to_lower_ascii_scalar(data + i, str.size() - i);
+}
+
+template <typename Alloc>
+void to_upper_ascii(BasicString<Alloc>& str) {
+  char* data = str.data();
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= str.size(); i += 16) {
+    auto ptr = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(ptr, to_upper_ascii(_mm_loadu_si128(ptr)));
+  }
+#endif
+  to_upper_ascii_scalar(data + i, str.size() - i);
+}
+
+int icompare_scalar(const char* a, size_t a_size, const char* b, size_t b_size) {
+  size_t common = std::min(a_size, b_size);
+  for (size_t i = 0; i < common; ++i) {
+    auto x = static_cast<unsigned char>(to_lower_ascii(a[i]));
+    auto y = static_cast<unsigned char>(to_lower_ascii(b[i]));
+    if (x != y) {
+      return x < y ? -1 : 1;
+    }
+  }
+  return a_size == b_size ? 0 : (a_size < b_size ? -1 : 1);
+}
+
+template <typename Alloc>
+int icompare(const BasicString<Alloc>& a, const BasicString<Alloc>& b) {
+  size_t i = 0;
+#ifdef __SSE2__
+  size_t common = std::min(a.size(), b.size());
+  for (; i + 16 <= common; i += 16) {
+    __m128i x = to_lower_ascii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a.data() + i)));
+    __m128i y = to_lower_ascii(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b.data() + i)));
+    unsigned mismatch = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFF;
+    if (mismatch) {
+      i += __builtin_ctz(mismatch);
+      break;
+    }
+  }
+#endif
+  return icompare_scalar(a.data() + i, a.size() - i, b.data() + i, b.size() - i);
+}
+
+template <typename Alloc>
+bool iequals(const BasicString<Alloc>& a, const BasicString<Alloc>& b) {
+  return a.size() == b.size() and icompare(a, b) == 0;
+}
+
+struct CaseInsensitiveLess {
+  template <typename Alloc>
+  bool operator()(const BasicString<Alloc>& a, const BasicString<Alloc>& b) const { return icompare(a, b) < 0; }
+};
+
+template <typename Alloc>
+int lexicographic_compare(const BasicString<Alloc>& a, const BasicString<Alloc>& b) {
+  size_t common = std::min(a.size(), b.size());
+  int result = common == 0 ? 0 : memcmp(a.data(), b.data(), common);
+  if (result != 0) {
+    return result;
   }
-  return in;
+  return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
 }
 
+struct LexicographicLess {
+  template <typename Alloc>
+  bool operator()(const BasicString<Alloc>& a, const BasicString<Alloc>& b) const {
+    return lexicographic_compare(a, b) < 0;
+  }
+};
+
+template <typename Alloc = std::allocator<char>>
+class BasicStringSorter {
+ private:
+  using Str = BasicString<Alloc>;
+
+  static constexpr size_t insertion_threshold_ = 32;
+  static constexpr size_t radix_threshold_ = 8192;
+  static constexpr size_t alphabet_ = 257;
+
+  std::vector<const Str*> scratch_;
+  std::vector<uint16_t> cache_;
+
+  static uint16_t char_at(const Str* str, size_t depth) {
+    return depth < str->size() ? static_cast<uint16_t>(static_cast<unsigned char>((*str)[depth]) + 1) : 0;
+  }
+
+  static bool suffix_less(const Str* a, const Str* b, size_t depth) {
+    size_t a_size = a->size() - depth;
+    size_t b_size = b->size() - depth;
+    size_t common = std::min(a_size, b_size);
+    int result = common == 0 ? 0 : memcmp(a->data() + depth, b->data() + depth, common);
+    return result < 0 or (result == 0 and a_size < b_size);
+  }
+
+  static void insertion_sort(const Str** keys, size_t n, size_t depth) {
+    for (size_t i = 1; i < n; ++i) {
+      const Str* key = keys[i];
+      size_t j = i;
+      while (j > 0 and suffix_less(key, keys[j - 1], depth)) {
+        keys[j] = keys[j - 1];
+        --j;
+      }
+      keys[j] = key;
+    }
+  }
+
+  // Depth past the prefix that every key shares; all keys must be longer than depth.
+  static size_t common_prefix(const Str* const* keys, size_t n, size_t depth) {
+    const char* first = keys[0]->data() + depth;
+    size_t common = keys[0]->size() - depth;
+    for (size_t i = 1; i < n and common > 0; ++i) {
+      const char* key = keys[i]->data() + depth;
+      size_t limit = std::min(common, keys[i]->size() - depth);
+      if (memcmp(first, key, limit) == 0) {
+        common = limit;
+        continue;
+      }
+      common = 0;
+      while (first[common] == key[common]) {
+        ++common;
+      }
+    }
+    return depth + common;
+  }
+
+  void fill_cache(const Str** keys, uint16_t* cache, size_t n, size_t depth) {
+    for (size_t i = 0; i < n; ++i) {
+      cache[i] = char_at(keys[i], depth);
+    }
+  }
+
+  struct RadixTask {
+    size_t begin;
+    size_t n;
+    size_t depth;
+  };
+
+  // Buckets that are still large go on an explicit stack instead of recursing, and a range whose
+  // keys all share the next character skips the whole shared prefix at once. Pending tasks cover
+  // disjoint ranges of at least radix_threshold_ keys, which bounds the stack.
+  void radix_sort(const Str** keys, uint16_t* cache, size_t n, size_t depth) {
+    std::vector<RadixTask> tasks{{0, n, depth}};
+    const Str** out = scratch_.data();
+    while (!tasks.empty()) {
+      RadixTask task = tasks.back();
+      tasks.pop_back();
+      const Str** part = keys + task.begin;
+      uint16_t* part_cache = cache + task.begin;
+      fill_cache(part, part_cache, task.n, task.depth);
+      size_t count[alphabet_] = {};
+      for (size_t i = 0; i < task.n; ++i) {
+        ++count[part_cache[i]];
+      }
+      if (count[part_cache[0]] == task.n) {
+        if (part_cache[0] != 0) {
+          tasks.push_back({task.begin, task.n, common_prefix(part, task.n, task.depth)});
+        }
+        continue;
+      }
+      size_t offset[alphabet_];
+      offset[0] = 0;
+      for (size_t c = 1; c < alphabet_; ++c) {
+        offset[c] = offset[c - 1] + count[c - 1];
+      }
+      for (size_t i = 0; i < task.n; ++i) {
+        out[offset[part_cache[i]]++] = part[i];
+      }
+      std::copy(out, out + task.n, part);
+      size_t start = count[0];
+      for (size_t c = 1; c < alphabet_; ++c) {
+        if (count[c] >= radix_threshold_) {
+          tasks.push_back({task.begin + start, count[c], task.depth + 1});
+        } else if (count[c] > 1) {
+          sort(part + start, part_cache + start, count[c], task.depth + 1, false);
+        }
+        start += count[c];
+      }
+    }
+  }
+
+  void multikey_quicksort(const Str** keys, uint16_t* cache, size_t n, size_t depth, bool cached) {
+    while (n >= insertion_threshold_) {
+      if (!cached) {
+        fill_cache(keys, cache, n, depth);
+      }
+      uint16_t a = cache[0], b = cache[n / 2], c = cache[n - 1];
+      uint16_t pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+      size_t lt = 0, i = 0, gt = n;
+      while (i < gt) {
+        if (cache[i] < pivot) {
+          std::swap(keys[lt], keys[i]);
+          std::swap(cache[lt++], cache[i++]);
+        } else if (cache[i] > pivot) {
+          --gt;
+          std::swap(keys[gt], keys[i]);
+          std::swap(cache[gt], cache[i]);
+        } else {
+          ++i;
+        }
+      }
+      sort(keys, cache, lt, depth, true);
+      sort(keys + gt, cache + gt, n - gt, depth, true);
+      if (pivot == 0) {
+        return;
+      }
+      keys += lt;
+      cache += lt;
+      n = gt - lt;
+      ++depth;
+      cached = false;
+    }
+    insertion_sort(keys, n, depth);
+  }
+
+  void sort(const Str** keys, uint16_t* cache, size_t n, size_t depth, bool cached) {
+    if (n < insertion_threshold_) {
+      insertion_sort(keys, n, depth);
+    } else if (n >= radix_threshold_) {
+      radix_sort(keys, cache, n, depth);
+    } else {
+      multikey_quicksort(keys, cache, n, depth, cached);
+    }
+  }
+
+ public:
+  template <typename RandomIt>
+  void operator()(RandomIt first, RandomIt last) {
+    size_t n = last - first;
+    std::vector<const Str*> keys(n);
+    for (size_t i = 0; i < n; ++i) {
+      keys[i] = &first[i];
+    }
+    scratch_.resize(n);
+    cache_.resize(n);
+    sort(keys.data(), cache_.data(), n, 0, false);
+    std::vector<Str> sorted;
+    sorted.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      sorted.push_back(std::move(*const_cast<Str*>(keys[i])));
+    }
+    std::move(sorted.begin(), sorted.end(), first);
+  }
+};
+
+using StringSorter = BasicStringSorter<>;
+
+template <typename RandomIt>
+void string_sort(RandomIt first, RandomIt last) {
+  using Str = typename std::iterator_traits<RandomIt>::value_type;
+  BasicStringSorter<typename Str::allocator_type>()(first, last);
+}
@@ -0,0 +1,198 @@
+// Checks that pooled UnorderedMap nodes go back to the store they came from: extract, merge and
+// node handles that are dropped must neither leak slab memory nor keep it alive after the last
+// node is gone. A counting allocator tracks the bytes in use; AddressSanitizer catches nodes that
+// are reused while still linked.
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined node_pool_check.cpp -o node_pool_check
+//   ./node_pool_check
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "../unordered_map.h"
+
+static size_t live_bytes = 0;
+static size_t allocations = 0;
+
+template <typename T>
+struct CountingAllocator {
+  using value_type = T;
+
+  CountingAllocator() = default;
+  template <typename U>
+  CountingAllocator(const CountingAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    live_bytes += n * sizeof(T);
+    ++allocations;
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* pointer, size_t n) {
+    live_bytes -= n * sizeof(T);
+    std::allocator<T>().deallocate(pointer, n);
+  }
+
+  friend bool operator==(const CountingAllocator&, const CountingAllocator&) { return true; }
+  friend bool operator!=(const CountingAllocator&, const CountingAllocator&) { return false; }
+};
+
+using Map = UnorderedMap<int, std::string, std::hash<int>, std::equal_to<int>,
+                         CountingAllocator<std::pair<const int, std::string>>>;
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    std::fprintf(stderr, "FAILED: %s\n", what);
+    std::exit(1);
+  }
+}
+
+// Long enough to live on the heap rather than in the small-string buffer.
+static std::string value_for(int key) {
+  return "value " + std::to_string(key) + " ..........................";
+}
+
+static void fill(Map& map, int from, int to) {
+  for (int key = from; key < to; ++key) {
+    map.emplace(key, value_for(key));
+  }
+}
+
+int main() {
+  const int n = 10000;
+
+  // A merge target that outlives its pooled source frees the source's slabs with the last node.
+  {
+    Map target;
+    size_t before = 0;
+    {
+      Map source;
+      source.reserve_nodes(n);
+      fill(source, 0, n);
+      target.merge(source);
+      check(source.empty() && target.size() == n, "merge moves every node");
+      before = live_bytes;
+    }
+    for (int key = 0; key < n; ++key) {
+      check(target.at(key) == value_for(key), "merged values survive the source");
+    }
+    target.clear();
+    check(live_bytes + n * sizeof(std::pair<const int, std::string>) < before, "merged slab freed after clear");
+  }
+  check(live_bytes == 0, "merge leaks nothing");
+
+  // A dropped handle gives its node back to the map it was extracted from.
+  {
+    Map map;
+    map.reserve(2 * n);
+    map.reserve_nodes(n);
+    fill(map, 0, n);
+    size_t before = allocations;
+    for (int key = 0; key < n; key += 10) {
+      Map::node_type handle = map.extract(key);
+      check(!handle.empty() && handle.mapped() == value_for(key), "extract returns the node");
+      handle = Map::node_type();
+    }
+    fill(map, n, n + n / 10);
+    check(allocations == before, "reset nodes are reused");
+    check(map.size() == n, "reuse keeps the size");
+  }
+  check(live_bytes == 0, "reset leaks nothing");
+
+  // A handle keeps its slab alive after the source is destroyed and can move to another map.
+  {
+    Map other;
+    Map::node_type handle;
+    {
+      Map source;
+      source.enable_node_pool();
+      fill(source, 0, 1000);
+      handle = source.extract(500);
+    }
+    check(handle.key() == 500 && handle.mapped() == value_for(500), "handle outlives its map");
+    auto result = other.insert(std::move(handle));
+    check(result.inserted && other.at(500) == value_for(500), "handle inserted elsewhere");
+    other.erase(500);
+    check(other.empty(), "erase after insert");
+  }
+  check(live_bytes == 0, "handles leak nothing");
+
+  // Nodes move back and forth between two pooled maps and a plain one.
+  {
+    Map a;
+    Map b;
+    Map plain;
+    std::map<int, std::string> ref_a;
+    std::map<int, std::string> ref_b;
+    a.enable_node_pool(16);
+    b.enable_node_pool(16);
+    std::mt19937 gen(3);
+    for (int round = 0; round < 20000; ++round) {
+      int key = static_cast<int>(gen() % 2000);
+      switch (gen() % 8) {
+        case 0:
+          a.emplace(key, value_for(key));
+          ref_a.emplace(key, value_for(key));
+          break;
+        case 1:
+          b.emplace(key, value_for(key));
+          ref_b.emplace(key, value_for(key));
+          break;
+        case 2:
+          a.erase(key);
+          ref_a.erase(key);
+          break;
+        case 3:
+          b.erase(key);
+          ref_b.erase(key);
+          break;
+        case 4: {
+          auto handle = a.extract(key);
+          if (!handle.empty() && b.insert(std::move(handle)).inserted) {
+            ref_b.emplace(key, ref_a[key]);
+          }
+          ref_a.erase(key);
+          break;
+        }
+        case 5:
+          if (gen() % 50 == 0) {
+            b.merge(a);
+            for (auto& entry : ref_a) {
+              ref_b.emplace(entry.first, entry.second);
+            }
+            ref_a.clear();
+            for (auto& entry : a) {
+              ref_a.emplace(entry.first, entry.second);
+            }
+          }
+          break;
+        case 6:
+          if (gen() % 50 == 0) {
+            plain.merge(b);
+            plain.clear();
+            ref_b.clear();
+            for (auto& entry : b) {
+              ref_b.emplace(entry.first, entry.second);
+            }
+          }
+          break;
+        default:
+          a.extract(key);
+          ref_a.erase(key);
+          break;
+      }
+    }
+    check(a.size() == ref_a.size() && b.size() == ref_b.size(), "sizes match");
+    for (auto& entry : ref_a) {
+      check(a.at(entry.first) == entry.second, "values in a");
+    }
+    for (auto& entry : ref_b) {
+      check(b.at(entry.first) == entry.second, "values in b");
+    }
+  }
+  check(live_bytes == 0, "mixed moves leak nothing");
+
+  std::puts("node pool: ok");
+}
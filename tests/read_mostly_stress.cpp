@@ -0,0 +1,145 @@
+// Stress test for ReadMostlyHashMap: reader threads run find/visit/contains/for_each while one
+// writer inserts, overwrites, erases, grows the table and clears it. Values are heap-allocated
+// strings, so a node freed too early shows up under AddressSanitizer; ThreadSanitizer checks the
+// publication and epoch protocol.
+//   g++ -std=c++17 -O1 -g -fsanitize=thread read_mostly_stress.cpp -o read_mostly_stress -pthread
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined read_mostly_stress.cpp -o read_mostly_stress -pthread
+//   ./read_mostly_stress [seconds] [readers]
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../unordered_map.h"
+
+static const int stable_keys = 1024;
+static const int key_range = 1 << 16;
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    std::fprintf(stderr, "FAILED: %s\n", what);
+    std::abort();
+  }
+}
+
+// Long enough to live on the heap rather than in the small-string buffer.
+static std::string value_for(int key, unsigned version) {
+  return "key " + std::to_string(key) + " version " + std::to_string(version) + " ........................";
+}
+
+static bool value_matches(int key, const std::string& value) {
+  std::string prefix = "key " + std::to_string(key) + " ";
+  return value.compare(0, prefix.size(), prefix) == 0;
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+  int reader_count = argc > 2 ? std::atoi(argv[2]) : 4;
+
+  ReadMostlyHashMap<int, std::string> map;
+  // Odd while the writer is clearing and refilling the stable keys.
+  std::atomic<unsigned> generation{0};
+  std::atomic<bool> stop{false};
+  std::atomic<size_t> reads{0};
+  std::atomic<size_t> writes{0};
+  std::atomic<size_t> cleared{0};
+  for (int key = 0; key < stable_keys; ++key) {
+    map.insert(key, value_for(key, 0));
+  }
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < reader_count; ++r) {
+    readers.emplace_back([&, r] {
+      std::mt19937 gen(r);
+      size_t done = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        int key = static_cast<int>(gen() % key_range);
+        unsigned before = generation.load(std::memory_order_acquire);
+        std::optional<std::string> value = map.find(key);
+        bool visited = map.visit(key, [&](const std::string& found) {
+          check(value_matches(key, found), "visit saw a value for another key");
+        });
+        bool contained = map.contains(key);
+        if (value) {
+          check(value_matches(key, *value), "find returned a value for another key");
+        }
+        if (key < stable_keys and before % 2 == 0 and generation.load(std::memory_order_acquire) == before) {
+          check(value and visited and contained, "stable key went missing");
+        }
+        if (++done % 4096 == 0) {
+          size_t seen = 0;
+          map.for_each([&](const auto& node) {
+            check(value_matches(node.first, node.second), "for_each saw a mismatched pair");
+            ++seen;
+          });
+          check(seen <= static_cast<size_t>(key_range), "for_each saw too many nodes");
+          std::this_thread::yield();
+        }
+      }
+      reads.fetch_add(done, std::memory_order_relaxed);
+    });
+  }
+
+  std::thread writer([&] {
+    std::mt19937 gen(12345);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    size_t done = 0;
+    size_t clears = 0;
+    unsigned version = 1;
+    while (std::chrono::steady_clock::now() < deadline) {
+      for (int step = 0; step < 1024; ++step, ++done) {
+        int key = stable_keys + static_cast<int>(gen() % (key_range - stable_keys));
+        switch (gen() % 4) {
+          case 0:
+            map.insert(key, value_for(key, version));
+            break;
+          case 1:
+            map.insert_or_assign(key, value_for(key, version));
+            break;
+          case 2:
+            map.erase(key);
+            break;
+          default: {
+            int stable = static_cast<int>(gen() % stable_keys);
+            map.insert_or_assign(stable, value_for(stable, version));
+          }
+        }
+      }
+      ++version;
+      if (version % 4 == 0) {
+        map.reserve(map.size() * 4);
+      }
+      if (version % 16 == 0) {
+        generation.fetch_add(1, std::memory_order_acq_rel);
+        map.clear();
+        for (int key = 0; key < stable_keys; ++key) {
+          map.insert(key, value_for(key, version));
+        }
+        generation.fetch_add(1, std::memory_order_acq_rel);
+        ++clears;
+      }
+    }
+    writes.store(done, std::memory_order_relaxed);
+    cleared.store(clears, std::memory_order_relaxed);
+  });
+
+  writer.join();
+  stop.store(true, std::memory_order_relaxed);
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+
+  size_t seen = 0;
+  map.for_each([&](const auto&) { ++seen; });
+  check(seen == map.size(), "size does not match the nodes");
+  for (int key = 0; key < stable_keys; ++key) {
+    check(map.contains(key), "stable key missing at the end");
+  }
+  map.collect();
+  std::printf("read_mostly_stress: %zu reads, %zu writes, %zu clears, %zu keys: ok\n", reads.load(), writes.load(),
+              cleared.load(), map.size());
+}
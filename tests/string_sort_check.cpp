@@ -0,0 +1,57 @@
+// Checks string_sort against std::sort with LexicographicLess.
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined string_sort_check.cpp -o string_sort_check
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../string.h"
+
+static void check(bool ok, const char* what) {
+  if (!ok) {
+    std::fprintf(stderr, "FAILED: %s\n", what);
+    std::exit(1);
+  }
+}
+
+static void check_sorted(std::vector<String> keys, const char* what) {
+  std::vector<String> expected = keys;
+  std::sort(expected.begin(), expected.end(), LexicographicLess());
+  string_sort(keys.begin(), keys.end());
+  check(keys.size() == expected.size(), what);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    check(keys[i] == expected[i], what);
+  }
+}
+
+int main() {
+  std::mt19937 gen(7);
+  for (size_t n : {0, 1, 5, 31, 32, 100, 5000, 8192, 50000}) {
+    std::vector<String> keys;
+    for (size_t i = 0; i < n; ++i) {
+      std::string key = gen() % 3 == 0 ? "http://example.com/" : "";
+      size_t length = gen() % 20;
+      for (size_t j = 0; j < length; ++j) {
+        key += static_cast<char>(gen() % 4 ? 'a' + gen() % 3 : gen() % 256);
+      }
+      keys.emplace_back(key.data(), key.size());
+    }
+    check_sorted(keys, "random keys");
+  }
+
+  std::vector<String> duplicates(20000, String("same"));
+  check_sorted(duplicates, "equal keys");
+
+  // Every key shares a 20,000 character prefix: the radix pass must not recurse per character.
+  std::string prefix(20000, 'p');
+  std::vector<String> shared;
+  for (size_t i = 0; i < 20000; ++i) {
+    std::string key = prefix + std::to_string(gen() % 100000);
+    shared.emplace_back(key.data(), key.size());
+  }
+  check_sorted(shared, "shared prefix");
+
+  std::puts("string_sort: ok");
+}
@@ -1,9 +1,46 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
 #include <tuple>
+#include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+template <bool CacheHash>
+struct NodeHashStorage {};
+
+template <>
+struct NodeHashStorage<true> {
+  size_t hash = 0;
+};
 
-template <typename T, typename Alloc = std::allocator<T>>
+template <typename T, typename Alloc = std::allocator<T>, bool CacheHash = false>
 class List {
  private:
 
@@ -14,7 +51,7 @@ class List {
     BaseNode(BaseNode *first, BaseNode *second) : prev(first), next(second) {}
   };
 
-  struct Node : public BaseNode {
+  struct Node : public BaseNode, public NodeHashStorage<CacheHash> {
     T value;
 
     Node() : BaseNode(nullptr, nullptr) {};
@@ -33,26 +70,284 @@ class List {
       typename Value,
       typename Hash,
       typename Equal,
-      typename Allocator>
+      typename Allocator,
+      typename BucketPolicy>
   friend
   class UnorderedMap;
   typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node> NodeAllocator;
 
  private:
+  // A slab is one contiguous allocation for many nodes. Slabs live in a shared SlabStore so that a
+  // node can move to another list (extract/merge) while its memory stays valid. A list holds its
+  // own store plus every store it has nodes from, counting those nodes; a node freed away from home
+  // goes back to its store's returned stack, where the owning list picks it up again, and a store
+  // is dropped once none of its nodes are left here, so it is freed with its last node. Nodes that
+  // did not come from a slab are returned to the allocator, on release_slabs() if the list pools.
+  struct Slab {
+    Node *nodes;
+    size_t count;
+  };
+  using SlabAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<Slab>;
+
+  struct SlabStore {
+    explicit SlabStore(const NodeAllocator &allocator) : alloc(allocator), slabs(SlabAllocator(allocator)) {}
+
+    SlabStore(const SlabStore &) = delete;
+    SlabStore &operator=(const SlabStore &) = delete;
+
+    ~SlabStore() {
+      for (const Slab &slab : slabs) {
+        std::allocator_traits<NodeAllocator>::deallocate(alloc, slab.nodes, slab.count);
+      }
+    }
+
+    // May be called from any thread, e.g. by a node handle; the owning list takes the whole stack.
+    void give_back(BaseNode *node) {
+      node->next = returned.load(std::memory_order_relaxed);
+      while (!returned.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+      }
+    }
+
+    BaseNode *take_returned() {
+      if (returned.load(std::memory_order_relaxed) == nullptr) {
+        return nullptr;
+      }
+      return returned.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    bool owns(const Node *node) const {
+      std::less<const Node *> less;
+      for (const Slab &slab : slabs) {
+        if (!less(node, slab.nodes) && less(node, slab.nodes + slab.count)) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    NodeAllocator alloc;
+    std::vector<Slab, SlabAllocator> slabs;
+    std::atomic<BaseNode *> returned{nullptr};
+  };
+
+  struct AdoptedStore {
+    std::shared_ptr<SlabStore> store;
+    size_t nodes;
+  };
+
+  static constexpr size_t max_pool_chunk_ = size_t(1) << 16;
+
   BaseNode fakeNode_;
   size_t size_;
   NodeAllocator node_allocator_;
   Alloc alloc_;
+  std::shared_ptr<SlabStore> slabs_;
+  std::vector<AdoptedStore> adopted_;
+  BaseNode *free_nodes_ = nullptr;
+  Node *slab_cursor_ = nullptr;
+  Node *slab_end_ = nullptr;
+  size_t pool_chunk_ = 0;
+
+  Node *allocate_node() {
+    if (free_nodes_ == nullptr && slabs_ != nullptr) {
+      free_nodes_ = slabs_->take_returned();
+    }
+    if (free_nodes_ != nullptr) {
+      BaseNode *node = free_nodes_;
+      free_nodes_ = node->next;
+      return static_cast<Node *>(node);
+    }
+    if (slab_cursor_ == slab_end_ && pool_chunk_ != 0) {
+      add_slab(pool_chunk_);
+      pool_chunk_ = std::min(2 * pool_chunk_, max_pool_chunk_);
+    }
+    if (slab_cursor_ != slab_end_) {
+      return slab_cursor_++;
+    }
+    return AllocTraits::allocate(node_allocator_, 1);
+  }
+
+  void deallocate_node(Node *node) {
+    for (size_t i = 0; i < adopted_.size(); ++i) {
+      if (adopted_[i].store->owns(node)) {
+        adopted_[i].store->give_back(node);
+        forget_adopted(i);
+        return;
+      }
+    }
+    if (slabs_ != nullptr) {
+      BaseNode *base = node;
+      base->next = free_nodes_;
+      free_nodes_ = base;
+      return;
+    }
+    AllocTraits::deallocate(node_allocator_, node, 1);
+  }
+
+  void forget_adopted(size_t i) {
+    if (--adopted_[i].nodes == 0) {
+      std::swap(adopted_[i], adopted_.back());
+      adopted_.pop_back();
+    }
+  }
+
+  std::shared_ptr<SlabStore> store_of(const Node *node) const {
+    if (slabs_ != nullptr && slabs_->owns(node)) {
+      return slabs_;
+    }
+    for (const AdoptedStore &adopted : adopted_) {
+      if (adopted.store->owns(node)) {
+        return adopted.store;
+      }
+    }
+    return nullptr;
+  }
+
+  // Called for a node that joins this list from store.
+  void adopt_node(const std::shared_ptr<SlabStore> &store) {
+    if (store == nullptr || store == slabs_) {
+      return;
+    }
+    for (AdoptedStore &adopted : adopted_) {
+      if (adopted.store == store) {
+        ++adopted.nodes;
+        return;
+      }
+    }
+    adopted_.push_back({store, 1});
+  }
+
+  // Called for a node that leaves this list without being freed; returns the store it came from.
+  std::shared_ptr<SlabStore> detach_node(const Node *node) {
+    for (size_t i = 0; i < adopted_.size(); ++i) {
+      if (adopted_[i].store->owns(node)) {
+        std::shared_ptr<SlabStore> store = adopted_[i].store;
+        forget_adopted(i);
+        return store;
+      }
+    }
+    return slabs_ != nullptr && slabs_->owns(node) ? slabs_ : nullptr;
+  }
+
+  void add_slab(size_t count) {
+    if (slabs_ == nullptr) {
+      slabs_ = std::make_shared<SlabStore>(node_allocator_);
+    }
+    slabs_->slabs.reserve(slabs_->slabs.size() + 1);
+    Node *nodes = AllocTraits::allocate(node_allocator_, count);
+    slabs_->slabs.push_back({nodes, count});
+    for (Node *node = slab_cursor_; node != slab_end_; ++node) {
+      BaseNode *base = node;
+      base->next = free_nodes_;
+      free_nodes_ = base;
+    }
+    slab_cursor_ = nodes;
+    slab_end_ = nodes + count;
+  }
+
+  void reserve_nodes(size_t count) {
+    size_t available = static_cast<size_t>(slab_end_ - slab_cursor_);
+    for (BaseNode *node = free_nodes_; node != nullptr && available < count; node = node->next) {
+      ++available;
+    }
+    if (available < count) {
+      add_slab(count - available);
+    }
+  }
+
+  // Nodes are taken from slabs that grow from first_chunk up to max_pool_chunk_ nodes; zero
+  // stops adding slabs, already pooled nodes are still recycled.
+  void set_pool_chunk(size_t first_chunk) {
+    pool_chunk_ = std::min(first_chunk, max_pool_chunk_);
+  }
+
+  void release_slabs() {
+    while (free_nodes_ != nullptr) {
+      Node *node = static_cast<Node *>(free_nodes_);
+      free_nodes_ = free_nodes_->next;
+      if (store_of(node) == nullptr) {
+        AllocTraits::deallocate(node_allocator_, node, 1);
+      }
+    }
+    slabs_.reset();
+    adopted_.clear();
+    slab_cursor_ = nullptr;
+    slab_end_ = nullptr;
+  }
+
+  void swap_slabs(List &other) {
+    std::swap(slabs_, other.slabs_);
+    std::swap(adopted_, other.adopted_);
+    std::swap(free_nodes_, other.free_nodes_);
+    std::swap(slab_cursor_, other.slab_cursor_);
+    std::swap(slab_end_, other.slab_end_);
+    std::swap(pool_chunk_, other.pool_chunk_);
+  }
+
+  template<typename... Args>
+  Node *create_node(Args &&... args) {
+    Node *node = allocate_node();
+    try {
+      std::allocator_traits<Alloc>::construct(alloc_, reinterpret_cast<T *>(&node->value), std::forward<Args>(args)...);
+    } catch (...) {
+      deallocate_node(node);
+      throw;
+    }
+    return node;
+  }
+
+  void destroy_node(BaseNode *node) {
+    AllocTraits::destroy(node_allocator_, reinterpret_cast<Node *>(node));
+    deallocate_node(reinterpret_cast<Node *>(node));
+  }
+
+  void link_before(BaseNode *right, BaseNode *node) {
+    BaseNode *left = right->prev;
+    node->prev = left;
+    node->next = right;
+    left->next = node;
+    right->prev = node;
+    ++size_;
+  }
+
+  void unlink(BaseNode *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    --size_;
+  }
+
+  // Appends an already linked run first..last of count nodes, e.g. one built by another thread.
+  void append_chain(BaseNode *first, BaseNode *last, size_t count) {
+    BaseNode *left = fakeNode_.prev;
+    left->next = first;
+    first->prev = left;
+    last->next = &fakeNode_;
+    fakeNode_.prev = last;
+    size_ += count;
+  }
+
+  BaseNode *release_nodes() {
+    if (size_ == 0) {
+      return nullptr;
+    }
+    BaseNode *first = fakeNode_.next;
+    fakeNode_.prev->next = nullptr;
+    fakeNode_.next = &fakeNode_;
+    fakeNode_.prev = &fakeNode_;
+    size_ = 0;
+    return first;
+  }
 
   void clean_up(size_t sz) {
     BaseNode *curr = fakeNode_.next;
     for (size_t i = 0; i < sz; ++i) {
       BaseNode *temp;
       temp = curr->next;
-      AllocTraits::destroy(node_allocator_, reinterpret_cast<Node *>(curr));
-      AllocTraits::deallocate(node_allocator_, reinterpret_cast<Node *>(curr), 1);
+      destroy_node(curr);
       curr = temp;
     }
+    fakeNode_.next = &fakeNode_;
+    fakeNode_.prev = &fakeNode_;
     size_ = 0;
   }
 
@@ -160,26 +455,35 @@ class List {
     return *this;
   }
   void copyList(List& other) {
+    if (other.size_ == 0) {
+      fakeNode_.next = &fakeNode_;
+      fakeNode_.prev = &fakeNode_;
+      return;
+    }
     fakeNode_.next = other.fakeNode_.next;
     fakeNode_.prev = other.fakeNode_.prev;
     fakeNode_.next->prev = &fakeNode_;
     fakeNode_.prev->next = &fakeNode_;
-    other.fakeNode_.prev = nullptr;
-    other.fakeNode_.next = nullptr;
+    other.fakeNode_.prev = &other.fakeNode_;
+    other.fakeNode_.next = &other.fakeNode_;
     other.size_ = 0;
   }
 
   List(List &&other) noexcept
       : size_(other.size_),
-        node_allocator_(std::move(other.node_allocator_)) {
+        node_allocator_(std::move(other.node_allocator_)),
+        alloc_(std::move(other.alloc_)) {
     copyList(other);
+    swap_slabs(other);
   }
 
   List &operator=(List &&other) noexcept {
     if (this != &other) {
       clear();
+      release_slabs();
       size_ = other.size_;
       copyList(other);
+      swap_slabs(other);
     }
     return *this;
   }
@@ -265,22 +569,29 @@ class List {
 
   template<typename... Args>
   void emplace(const_iterator it, Args &&... args) {
-    BaseNode *right = it.get_node_ptr();
-    BaseNode *left = right->prev;
-    Node *to_be_inserted;
-    try {
-      to_be_inserted = AllocTraits::allocate(node_allocator_, 1);
-      std::allocator_traits<Alloc>::construct(alloc_,
-                                              reinterpret_cast<T *>(&to_be_inserted->value),
-                                              std::forward<Args>(args)...);
-    } catch (...) {
-      throw;
+    link_before(it.get_node_ptr(), create_node(std::forward<Args>(args)...));
+  }
+
+  // Moves the node at it in front of position; both must belong to this list.
+  void splice(const_iterator position, const_iterator it) {
+    BaseNode *node = it.get_node_ptr();
+    BaseNode *right = position.get_node_ptr();
+    if (node == right || node->next == right) {
+      return;
     }
-    to_be_inserted->next = right;
-    to_be_inserted->prev = left;
-    right->prev = to_be_inserted;
-    left->next = to_be_inserted;
-    ++size_;
+    unlink(node);
+    link_before(right, node);
+  }
+
+  // Moves the node at it from other in front of position; the lists must share an allocator.
+  void splice(const_iterator position, List &other, const_iterator it) {
+    if (&other == this) {
+      splice(position, it);
+      return;
+    }
+    BaseNode *node = it.get_node_ptr();
+    other.unlink(node);
+    link_before(position.get_node_ptr(), node);
   }
 
   void insert_before(BaseNode *node, BaseNode *curr) {
@@ -308,8 +619,7 @@ class List {
     BaseNode *right = to_be_erased->next;
     left->next = right;
     right->prev = left;
-    AllocTraits::destroy(node_allocator_, reinterpret_cast<Node *>(to_be_erased));
-    AllocTraits::deallocate(node_allocator_, reinterpret_cast<Node *>(to_be_erased), 1);
+    destroy_node(to_be_erased);
     --size_;
   }
 
@@ -340,6 +650,7 @@ class List {
 
   ~List() {
     clean_up(size_);
+    release_slabs();
   }
 
  List(size_t size, Alloc allocator = Alloc()): fakeNode_(&fakeNode_, &fakeNode_),
@@ -432,126 +743,799 @@ class List {
 
 
 
+struct PowerOfTwoBucketPolicy {
+  unsigned shift_ = 64 - 5;
+
+  size_t bucket_count(size_t n) const {
+    size_t count = 2;
+    while (count < n) {
+      count *= 2;
+    }
+    return count;
+  }
+
+  void resize(size_t n) {
+    shift_ = 64 - __builtin_ctzll(n);
+  }
+
+  size_t index(size_t hash) const {
+    return static_cast<size_t>((static_cast<uint64_t>(hash) * 11400714819323198485ull) >> shift_);
+  }
+};
+
+struct PrimeBucketPolicy {
+  size_t count_ = 37;
+
+  size_t bucket_count(size_t n) const {
+    static const uint64_t primes[] = {
+      3ull, 5ull, 11ull, 17ull, 37ull, 67ull, 131ull, 257ull, 521ull, 1031ull, 2053ull, 4099ull, 8209ull,
+      16411ull, 32771ull, 65537ull, 131101ull, 262147ull, 524309ull, 1048583ull, 2097169ull, 4194319ull,
+      8388617ull, 16777259ull, 33554467ull, 67108879ull, 134217757ull, 268435459ull, 536870923ull,
+      1073741827ull, 2147483659ull, 4294967311ull, 8589934609ull, 17179869209ull, 34359738421ull,
+      68719476767ull, 137438953481ull, 274877906951ull, 549755813911ull, 1099511627791ull, 2199023255579ull,
+      4398046511119ull, 8796093022237ull, 17592186044423ull, 35184372088891ull, 70368744177679ull,
+      140737488355333ull, 281474976710677ull, 562949953421381ull, 1125899906842679ull, 2251799813685269ull,
+      4503599627370517ull, 9007199254740997ull, 18014398509482143ull, 36028797018963971ull,
+      72057594037928017ull, 144115188075855881ull, 288230376151711813ull, 576460752303423619ull,
+      1152921504606847009ull, 2305843009213693967ull, 4611686018427388039ull, 9223372036854775837ull};
+    for (uint64_t prime : primes) {
+      if (prime >= n) {
+        return prime;
+      }
+    }
+    return primes[sizeof(primes) / sizeof(primes[0]) - 1];
+  }
+
+  void resize(size_t n) {
+    count_ = n;
+  }
+
+  size_t index(size_t hash) const {
+    return hash % count_;
+  }
+};
+
+inline void prefetch_read(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(address, 0, 3);
+#else
+  std::ignore = address;
+#endif
+}
+
+template <typename T, typename = void>
+struct has_is_transparent : std::false_type {};
+
+template <typename T>
+struct has_is_transparent<T, std::void_t<typename T::is_transparent>> : std::true_type {};
+
+struct StringViewHash {
+  using is_transparent = void;
+  size_t operator()(std::string_view str) const {
+    return std::hash<std::string_view>()(str);
+  }
+};
+
+// True when *it has a .first of type Key, so its hash can be taken before a node is built.
+template <typename InputIterator, typename Key, typename = void>
+struct iterator_has_key : std::false_type {};
+
+template <typename InputIterator, typename Key>
+struct iterator_has_key<InputIterator, Key,
+                        std::enable_if_t<std::is_same<std::decay_t<decltype((*std::declval<InputIterator&>()).first)>,
+                                                      Key>::value>> : std::true_type {};
+
+template <typename Key, typename Hash>
+struct hash_is_cheap
+    : std::integral_constant<bool, std::is_same<Hash, std::hash<Key>>::value &&
+                                   (std::is_arithmetic<Key>::value || std::is_enum<Key>::value ||
+                                    std::is_pointer<Key>::value)> {};
+
+template <typename Key, typename Value, typename Hash, typename Equal>
+class FrozenMap;
+
+template <typename Key, typename Value, typename Hash, typename Equal>
+class MappedUnorderedMap;
+
+// The chain and bucket figures are computed on demand by UnorderedMap::stats(). The counters are
+// only maintained when UNORDERED_MAP_STATS is defined and stay zero otherwise; lookup_hits and
+// lookup_misses count find, count, contains, at and find_batch, not the probes done by inserts.
+struct UnorderedMapStats {
+  size_t size = 0;
+  size_t bucket_count = 0;
+  size_t empty_buckets = 0;
+  size_t max_chain_length = 0;
+  double average_chain_length = 0;
+  double empty_bucket_ratio = 0;
+  double load_factor = 0;
+  size_t rehash_count = 0;
+  double rehash_seconds = 0;
+  size_t lookup_hits = 0;
+  size_t lookup_misses = 0;
+
+  std::string to_json() const {
+    return "{\"size\":" + std::to_string(size) +
+           ",\"bucket_count\":" + std::to_string(bucket_count) +
+           ",\"empty_buckets\":" + std::to_string(empty_buckets) +
+           ",\"max_chain_length\":" + std::to_string(max_chain_length) +
+           ",\"average_chain_length\":" + std::to_string(average_chain_length) +
+           ",\"empty_bucket_ratio\":" + std::to_string(empty_bucket_ratio) +
+           ",\"load_factor\":" + std::to_string(load_factor) +
+           ",\"rehash_count\":" + std::to_string(rehash_count) +
+           ",\"rehash_seconds\":" + std::to_string(rehash_seconds) +
+           ",\"lookup_hits\":" + std::to_string(lookup_hits) +
+           ",\"lookup_misses\":" + std::to_string(lookup_misses) + "}";
+  }
+};
+
+// Lookups bump their counters from const methods, and ConcurrentUnorderedMap runs them under a
+// shared lock, so the counters are relaxed atomics. Copies take a snapshot.
+class RelaxedCounter {
+ private:
+  std::atomic<size_t> value_{0};
+
+ public:
+  RelaxedCounter() = default;
+  RelaxedCounter(const RelaxedCounter& other) noexcept : value_(other.load()) {}
+  RelaxedCounter& operator=(const RelaxedCounter& other) noexcept {
+    value_.store(other.load(), std::memory_order_relaxed);
+    return *this;
+  }
+
+  void increment() {
+    value_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  size_t load() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+  void reset() {
+    value_.store(0, std::memory_order_relaxed);
+  }
+};
+
 template <typename Key,
           typename Value,
           typename Hash = std::hash<Key>,
           typename Equal = std::equal_to<Key>,
-          typename Alloc = std::allocator<std::pair<const Key, Value>>>
+          typename Alloc = std::allocator<std::pair<const Key, Value>>,
+          typename BucketPolicy = PowerOfTwoBucketPolicy>
 class UnorderedMap {
  public:
   using NodeType = std::pair<const Key, Value>;
  private:
+  static constexpr bool cache_hash_ = !hash_is_cheap<Key, Hash>::value;
   using NodeTypeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<NodeType>;
-  using BucketsType = typename List<NodeType, NodeTypeAlloc>::iterator;
+  using ListType = List<NodeType, NodeTypeAlloc, cache_hash_>;
+  using BaseNode = typename ListType::BaseNode;
+  using Node = typename ListType::Node;
+  using BucketsType = typename ListType::iterator;
   using BucketsAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<BucketsType>;
 
+  template<typename K,
+      typename V,
+      typename H,
+      typename E,
+      typename A>
+  friend
+  class ConcurrentUnorderedMap;
+
   Alloc alloc_;
-  List<NodeType, NodeTypeAlloc> list_;
+  ListType list_;
   std::vector<BucketsType, BucketsAlloc> buckets_;
+  std::vector<BucketsType, BucketsAlloc> old_buckets_;
   Hash hashFunc_;
   Equal equalFunc_;
+  BucketPolicy policy_;
+  BucketPolicy old_policy_;
+  size_t migrated_ = 0;
+  size_t rehash_step_ = 0;
   float max_load_factor_ = 0.8;
   static const size_t default_size_ = 32;
+#ifdef UNORDERED_MAP_STATS
+  UnorderedMapStats stats_;
+  mutable RelaxedCounter lookup_hits_;
+  mutable RelaxedCounter lookup_misses_;
+#endif
+
+  BaseNode* end_node() const {
+    return const_cast<BaseNode*>(&list_.fakeNode_);
+  }
 
-  void check_for_rehash() {
-    if ((list_.size() / buckets_.size()) > max_load_factor_) {
-      rehash(2 * buckets_.size());
+  size_t node_hash(const BaseNode* node) const {
+    if constexpr (cache_hash_) {
+      return static_cast<const Node*>(node)->hash;
+    } else {
+      return hashFunc_(static_cast<const Node*>(node)->value.first);
     }
   }
 
-  void rehash(size_t n) {
-    std::vector<BucketsType, BucketsAlloc> new_buckets(n, list_.end(), alloc_);
-
-    iterator curr = list_.begin();
-    while (curr != list_.end()) {
-      size_t hash = hashFunc_(curr->first) % n;
-      if (new_buckets[hash] != list_.end()) {
-        list_.insert_before(curr++.get_node_ptr(), new_buckets[hash].get_node_ptr());
-      } else {
-        new_buckets[hash] = curr++;
-      }
+  void set_node_hash(BaseNode* node, size_t hash) {
+    if constexpr (cache_hash_) {
+      static_cast<Node*>(node)->hash = hash;
+    } else {
+      std::ignore = node;
+      std::ignore = hash;
     }
-    buckets_ = std::move(new_buckets);
   }
 
- public:
-  using iterator = typename List<NodeType, NodeTypeAlloc>::iterator;;
-  using const_iterator = typename List<NodeType, NodeTypeAlloc>::const_iterator;
-  using reverse_iterator = std::reverse_iterator<iterator>;
-  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
-  using AllocTraits = typename std::allocator_traits<Alloc>;
+  size_t bucket_index(size_t hash) const {
+    return policy_.index(hash);
+  }
 
-  iterator begin() {
-    return list_.begin();
+  // While an incremental rehash is in progress a node lives in the new table iff its bucket
+  // in the old table has already been migrated, so every key has exactly one home.
+  bool migrating() const {
+    return migrated_ < old_buckets_.size();
   }
 
-  iterator end() {
-    return list_.end();
+  bool in_new_table(size_t hash) const {
+    return !migrating() || old_policy_.index(hash) < migrated_;
   }
 
-  const_iterator begin() const {
-    return list_.cbegin();
+  void drop_old_buckets() {
+    old_buckets_.clear();
+    old_buckets_.shrink_to_fit();
+    migrated_ = 0;
   }
 
-  const_iterator end() const {
-    return list_.cend();
+  void reset_buckets(size_t n) {
+    drop_old_buckets();
+    n = policy_.bucket_count(n);
+    policy_.resize(n);
+    buckets_.assign(n, list_.end());
   }
 
-  const_iterator cbegin() {
-    return list_.cbegin();
+  template<typename K>
+  bool key_matches(const BaseNode* node, size_t hash, const K& key) const {
+    if constexpr (cache_hash_) {
+      if (static_cast<const Node*>(node)->hash != hash) {
+        return false;
+      }
+    } else {
+      std::ignore = hash;
+    }
+    return equalFunc_(static_cast<const Node*>(node)->value.first, key);
   }
 
-  const_iterator cend() {
-    return list_.cend();
+  // Walks the chain that starts at node, the head of bucket in the new or the old table.
+  template<typename K>
+  BaseNode* find_in_bucket(const K& key, size_t hash, BaseNode* node, size_t bucket, bool fresh) const {
+    const BucketPolicy& policy = fresh ? policy_ : old_policy_;
+    BaseNode* end = end_node();
+    while (node != end) {
+      size_t curr_hash = node_hash(node);
+      if (policy.index(curr_hash) != bucket || in_new_table(curr_hash) != fresh) {
+        break;
+      }
+      if (key_matches(node, hash, key)) {
+        return node;
+      }
+      node = node->next;
+    }
+    return end;
   }
 
-  const_iterator cbegin() const {
-    return cbegin();
+  // Only the public lookups are counted; inserts probe with find_node as well.
+  BaseNode* count_lookup(BaseNode* node) const {
+#ifdef UNORDERED_MAP_STATS
+    if (node != end_node()) {
+      lookup_hits_.increment();
+    } else {
+      lookup_misses_.increment();
+    }
+#endif
+    return node;
   }
 
-  const_iterator cend() const {
-    return cend();
+  template<typename K>
+  BaseNode* find_node(const K& key, size_t hash) const {
+    bool fresh = in_new_table(hash);
+    size_t bucket = (fresh ? policy_ : old_policy_).index(hash);
+    return find_in_bucket(key, hash, (fresh ? buckets_ : old_buckets_)[bucket].get_node_ptr(), bucket, fresh);
   }
 
-  reverse_iterator rbegin() {
-    return std::reverse_iterator<iterator>(end());
+  void link_node(BaseNode* node, size_t hash, std::vector<BucketsType, BucketsAlloc>& buckets,
+                 const BucketPolicy& policy) {
+    set_node_hash(node, hash);
+    size_t bucket = policy.index(hash);
+    BaseNode* head = buckets[bucket].get_node_ptr();
+    list_.link_before(head != end_node() ? head : list_.fakeNode_.next, node);
+    buckets[bucket] = BucketsType(node);
   }
 
-  reverse_iterator rend() {
-    return std::reverse_iterator<iterator>(begin());
+  void link_new_node(BaseNode* node, size_t hash) {
+    if (in_new_table(hash)) {
+      link_node(node, hash, buckets_, policy_);
+    } else {
+      link_node(node, hash, old_buckets_, old_policy_);
+    }
   }
 
-  const_reverse_iterator rbegin() const {
-    return crbegin();
+  void unlink_node(BaseNode* node) {
+    size_t hash = node_hash(node);
+    bool fresh = in_new_table(hash);
+    std::vector<BucketsType, BucketsAlloc>& buckets = fresh ? buckets_ : old_buckets_;
+    const BucketPolicy& policy = fresh ? policy_ : old_policy_;
+    size_t bucket = policy.index(hash);
+    if (buckets[bucket].get_node_ptr() == node) {
+      BaseNode* next = node->next;
+      size_t next_hash = next != end_node() ? node_hash(next) : 0;
+      if (next != end_node() and policy.index(next_hash) == bucket and in_new_table(next_hash) == fresh) {
+        buckets[bucket] = BucketsType(next);
+      } else {
+        buckets[bucket] = list_.end();
+      }
+    }
+    list_.unlink(node);
   }
 
-  const_reverse_iterator rend() const {
-    return crend();
+  // Moves up to count buckets of the old table into the new one. Only the nodes of the migrated
+  // bucket are touched, so the cost of a step is bounded by the chain length, not by size().
+  void migrate_buckets(size_t count) {
+#ifdef UNORDERED_MAP_STATS
+    auto started = std::chrono::steady_clock::now();
+#endif
+    while (count-- > 0 && migrating()) {
+      size_t bucket = migrated_++;
+      BaseNode* node = old_buckets_[bucket].get_node_ptr();
+      old_buckets_[bucket] = list_.end();
+      BaseNode* run = nullptr;
+      while (node != end_node() && old_policy_.index(node_hash(node)) == bucket) {
+        BaseNode* next = node->next;
+        list_.unlink(node);
+        node->next = run;
+        run = node;
+        node = next;
+      }
+      while (run != nullptr) {
+        BaseNode* next = run->next;
+        link_node(run, node_hash(run), buckets_, policy_);
+        run = next;
+      }
+    }
+    if (!old_buckets_.empty() && !migrating()) {
+      drop_old_buckets();
+    }
+#ifdef UNORDERED_MAP_STATS
+    stats_.rehash_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+#endif
   }
 
-  const_reverse_iterator crbegin() const {
-    return std::make_reverse_iterator(cend());
+  void start_incremental_rehash(size_t n) {
+    migrate_buckets(old_buckets_.size());
+    n = policy_.bucket_count(n);
+    old_buckets_ = std::move(buckets_);
+    old_policy_ = policy_;
+    policy_.resize(n);
+    buckets_.assign(n, list_.end());
+    migrated_ = 0;
+#ifdef UNORDERED_MAP_STATS
+    ++stats_.rehash_count;
+#endif
   }
 
-  const_reverse_iterator crend() const {
-    return std::make_reverse_iterator(cbegin());
+  void check_for_rehash() {
+    if (migrating()) {
+      // Keep ahead of the next growth, or its start would migrate the rest in one pause.
+      double headroom = std::max(static_cast<double>(buckets_.size()) * max_load_factor_ -
+                                 static_cast<double>(list_.size()), 1.0);
+      size_t needed = static_cast<size_t>(std::ceil(static_cast<double>(old_buckets_.size() - migrated_) / headroom));
+      migrate_buckets(std::max(rehash_step_, needed));
+    }
+    if (static_cast<float>(list_.size()) > static_cast<float>(buckets_.size()) * max_load_factor_) {
+      if (rehash_step_ == 0) {
+        rehash(2 * buckets_.size());
+      } else {
+        start_incremental_rehash(2 * buckets_.size());
+      }
+    }
   }
 
-  const_reverse_iterator crbegin() {
-    return std::reverse_iterator<const_iterator>(cend());
+  void rehash(size_t n) {
+#ifdef UNORDERED_MAP_STATS
+    auto started = std::chrono::steady_clock::now();
+#endif
+    drop_old_buckets();
+    n = policy_.bucket_count(n);
+    BucketPolicy new_policy = policy_;
+    new_policy.resize(n);
+    std::vector<BucketsType, BucketsAlloc> new_buckets(n, list_.end(), alloc_);
+    BaseNode* curr = list_.release_nodes();
+    while (curr != nullptr) {
+      BaseNode* next = curr->next;
+      link_node(curr, node_hash(curr), new_buckets, new_policy);
+      curr = next;
+    }
+    buckets_ = std::move(new_buckets);
+    policy_ = new_policy;
+#ifdef UNORDERED_MAP_STATS
+    ++stats_.rehash_count;
+    stats_.rehash_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+#endif
   }
 
-  const_reverse_iterator crend() {
-    return std::reverse_iterator<const_iterator>(cbegin());
+  template<typename Fn>
+  static void run_parallel(size_t threads, Fn fn) {
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (size_t t = 1; t < threads; ++t) {
+      try {
+        workers.emplace_back(fn, t);
+      } catch (const std::system_error&) {
+        fn(t);
+      }
+    }
+    fn(0);
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
   }
 
+  // The relink makes extra passes over the nodes and is 1.5-1.8x slower than rehash() on one
+  // thread, so by default it only runs with at least 4 hardware threads and 64K nodes per thread.
+  static size_t parallel_threads(size_t threads, size_t count) {
+    static constexpr size_t min_nodes_per_thread = 1 << 16;
+    static constexpr size_t min_default_threads = 4;
+    if (threads == 0) {
+      threads = std::thread::hardware_concurrency();
+      if (threads < min_default_threads) {
+        return 1;
+      }
+    }
+    return std::max<size_t>(std::min(threads, count / min_nodes_per_thread), 1);
+  }
 
+  // Relinks the whole list plus the unlinked nodes in added into a fresh table of n buckets on
+  // threads threads. Each thread owns a contiguous range of buckets: a stable counting sort by
+  // range hands it its nodes, it links them into a private chain and the chains are appended in
+  // range order, so every bucket is still one contiguous run. An added node whose key is already
+  // present is not linked but returned through a chain of next pointers; the order is stable, so
+  // the first occurrence wins as in insert(). Hash and Equal are called concurrently.
+  BaseNode* relink_parallel(const std::vector<BaseNode*>& added, size_t n, size_t threads) {
+    BucketPolicy new_policy = policy_;
+    new_policy.resize(n);
+    size_t first_new = list_.size();
+    size_t count = first_new + added.size();
+    std::vector<BaseNode*> nodes;
+    nodes.reserve(count);
+    for (BaseNode* node = list_.fakeNode_.next; node != end_node(); node = node->next) {
+      nodes.push_back(node);
+    }
+    nodes.insert(nodes.end(), added.begin(), added.end());
+    std::vector<BucketsType, BucketsAlloc> new_buckets(n, list_.end(), alloc_);
+    std::vector<size_t> bucket_of(count);
+    std::vector<size_t> order(count);
+    std::vector<size_t> offsets(threads * threads, 0);
+    std::vector<size_t> part_begin(threads + 1, count);
+    std::vector<BaseNode> chains(threads);
+    std::vector<size_t> linked(threads, 0);
+    std::vector<BaseNode*> rejected(threads, nullptr);
+    auto range_of = [&](size_t bucket) { return ((bucket + 1) * threads - 1) / n; };
+    auto slice_begin = [&](size_t t) { return t * count / threads; };
+
+    run_parallel(threads, [&](size_t t) {
+      for (size_t i = slice_begin(t); i < slice_begin(t + 1); ++i) {
+        bucket_of[i] = new_policy.index(node_hash(nodes[i]));
+        ++offsets[t * threads + range_of(bucket_of[i])];
+      }
+    });
+    size_t total = 0;
+    for (size_t part = 0; part < threads; ++part) {
+      part_begin[part] = total;
+      for (size_t t = 0; t < threads; ++t) {
+        size_t slice_count = offsets[t * threads + part];
+        offsets[t * threads + part] = total;
+        total += slice_count;
+      }
+    }
+    run_parallel(threads, [&](size_t t) {
+      for (size_t i = slice_begin(t); i < slice_begin(t + 1); ++i) {
+        order[offsets[t * threads + range_of(bucket_of[i])]++] = i;
+      }
+    });
+
+    list_.release_nodes();
+    run_parallel(threads, [&](size_t part) {
+      BaseNode* chain = &chains[part];
+      chain->prev = chain;
+      chain->next = chain;
+      for (size_t k = part_begin[part]; k < part_begin[part + 1]; ++k) {
+        size_t i = order[k];
+        BaseNode* node = nodes[i];
+        size_t bucket = bucket_of[i];
+        BaseNode* head = new_buckets[bucket].get_node_ptr();
+        if (head == end_node()) {
+          head = chain;
+        } else if (i >= first_new) {
+          size_t hash = node_hash(node);
+          const Key& key = static_cast<Node*>(node)->value.first;
+          BaseNode* curr = head;
+          while (curr != chain && new_policy.index(node_hash(curr)) == bucket) {
+            if (key_matches(curr, hash, key)) {
+              break;
+            }
+            curr = curr->next;
+          }
+          if (curr != chain && new_policy.index(node_hash(curr)) == bucket) {
+            node->next = rejected[part];
+            rejected[part] = node;
+            continue;
+          }
+        }
+        node->prev = head->prev;
+        node->next = head;
+        head->prev->next = node;
+        head->prev = node;
+        new_buckets[bucket] = BucketsType(node);
+        ++linked[part];
+      }
+    });
 
+    BaseNode* duplicates = nullptr;
+    for (size_t part = 0; part < threads; ++part) {
+      if (linked[part] != 0) {
+        list_.append_chain(chains[part].next, chains[part].prev, linked[part]);
+      }
+      while (rejected[part] != nullptr) {
+        BaseNode* next = rejected[part]->next;
+        rejected[part]->next = duplicates;
+        duplicates = rejected[part];
+        rejected[part] = next;
+      }
+    }
+    buckets_ = std::move(new_buckets);
+    policy_ = new_policy;
+    return duplicates;
+  }
+
+  void copy_nodes(const UnorderedMap& other) {
+    policy_ = other.policy_;
+    buckets_.assign(other.buckets_.size(), list_.end());
+    for (const BaseNode* node = other.list_.fakeNode_.next; node != other.end_node(); node = node->next) {
+      BaseNode* copy = list_.create_node(static_cast<const Node*>(node)->value);
+      link_node(copy, other.node_hash(node), buckets_, policy_);
+    }
+  }
+
+  const BucketsType& bucket_slot(size_t hash) const {
+    if (in_new_table(hash)) {
+      return buckets_[policy_.index(hash)];
+    }
+    return old_buckets_[old_policy_.index(hash)];
+  }
+
+  // A group goes through every stage before the next stage starts, so the prefetches of one stage
+  // are all in flight while later keys are still issuing theirs: bucket slots, then chain heads,
+  // then, for keys that neither hit an empty bucket nor match the head, the node after the head.
+  template<typename ForwardIt, typename Emit>
+  void find_batch_impl(ForwardIt first, ForwardIt last, Emit emit) const {
+    static constexpr size_t group_size = 128;
+    size_t hashes[group_size];
+    size_t buckets[group_size];
+    bool fresh[group_size];
+    ForwardIt keys[group_size];
+    BaseNode* found[group_size];
+    size_t unresolved[group_size];
+    BaseNode* end = end_node();
+    while (first != last) {
+      size_t count = 0;
+      for (; count < group_size && first != last; ++count, ++first) {
+        keys[count] = first;
+        hashes[count] = hashFunc_(*first);
+        fresh[count] = in_new_table(hashes[count]);
+        buckets[count] = (fresh[count] ? policy_ : old_policy_).index(hashes[count]);
+        prefetch_read(&(fresh[count] ? buckets_ : old_buckets_)[buckets[count]]);
+      }
+      for (size_t i = 0; i < count; ++i) {
+        found[i] = (fresh[i] ? buckets_ : old_buckets_)[buckets[i]].get_node_ptr();
+        prefetch_read(found[i]);
+      }
+      size_t pending = 0;
+      for (size_t i = 0; i < count; ++i) {
+        if (found[i] != end && !key_matches(found[i], hashes[i], *keys[i])) {
+          found[i] = found[i]->next;
+          prefetch_read(found[i]);
+          unresolved[pending++] = i;
+        }
+      }
+      for (size_t j = 0; j < pending; ++j) {
+        size_t i = unresolved[j];
+        found[i] = find_in_bucket(*keys[i], hashes[i], found[i], buckets[i], fresh[i]);
+      }
+      for (size_t i = 0; i < count; ++i) {
+        emit(count_lookup(found[i]));
+      }
+    }
+  }
+
+  template<typename T>
+  void insert_hashed(size_t hash, T&& item) {
+    if (find_node(item.first, hash) == end_node()) {
+      link_new_node(list_.create_node(std::forward<T>(item)), hash);
+    }
+  }
+
+  template<typename... Args>
+  BaseNode* emplace_node(size_t hash, Args&&... args) {
+    BaseNode* node = list_.create_node(std::forward<Args>(args)...);
+    link_new_node(node, hash);
+    check_for_rehash();
+    return node;
+  }
+
+ public:
+  using iterator = typename ListType::iterator;
+  using const_iterator = typename ListType::const_iterator;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+  using AllocTraits = typename std::allocator_traits<Alloc>;
+
+  // Owns one element detached from a map. A node that came from a slab keeps its slab store alive,
+  // so the handle can outlive the source map and be inserted into another one without copying;
+  // dropping the handle gives the node back to its store for the source map to reuse.
+  class node_type {
+   public:
+    node_type() = default;
+
+    node_type(node_type&& other) noexcept
+        : node_(other.node_),
+          alloc_(std::move(other.alloc_)),
+          store_(std::move(other.store_)) {
+      other.node_ = nullptr;
+    }
+
+    node_type& operator=(node_type&& other) noexcept {
+      if (this != &other) {
+        reset();
+        std::swap(node_, other.node_);
+        std::swap(alloc_, other.alloc_);
+        std::swap(store_, other.store_);
+      }
+      return *this;
+    }
+
+    ~node_type() {
+      reset();
+    }
+
+    bool empty() const {
+      return node_ == nullptr;
+    }
+
+    explicit operator bool() const {
+      return node_ != nullptr;
+    }
+
+    const Key& key() const {
+      return static_cast<Node*>(node_)->value.first;
+    }
+
+    Value& mapped() const {
+      return static_cast<Node*>(node_)->value.second;
+    }
+
+   private:
+    using NodeAllocator = typename ListType::NodeAllocator;
+    using SlabStorePtr = decltype(std::declval<ListType&>().store_of(nullptr));
+
+    BaseNode* node_ = nullptr;
+    std::optional<NodeAllocator> alloc_;
+    SlabStorePtr store_;
+
+    node_type(BaseNode* node, const NodeAllocator& alloc, SlabStorePtr store)
+        : node_(node),
+          alloc_(alloc),
+          store_(std::move(store)) {}
+
+    BaseNode* release() {
+      BaseNode* node = node_;
+      node_ = nullptr;
+      return node;
+    }
+
+    void reset() {
+      if (node_ != nullptr) {
+        std::allocator_traits<NodeAllocator>::destroy(*alloc_, static_cast<Node*>(node_));
+        if (store_ == nullptr) {
+          std::allocator_traits<NodeAllocator>::deallocate(*alloc_, static_cast<Node*>(node_), 1);
+        } else {
+          store_->give_back(node_);
+        }
+        node_ = nullptr;
+      }
+      store_ = nullptr;
+    }
+
+    friend class UnorderedMap;
+  };
+
+  struct insert_return_type {
+    iterator position;
+    bool inserted;
+    node_type node;
+  };
+
+ private:
+  static constexpr bool transparent_ = has_is_transparent<Hash>::value && has_is_transparent<Equal>::value;
+
+  template<typename K>
+  using enable_if_transparent = std::enable_if_t<transparent_ && !std::is_convertible<K, const_iterator>::value &&
+                                                 !std::is_convertible<K, iterator>::value>;
+
+ public:
+  iterator begin() {
+    return list_.begin();
+  }
+
+  iterator end() {
+    return list_.end();
+  }
+
+  const_iterator begin() const {
+    return list_.cbegin();
+  }
+
+  const_iterator end() const {
+    return list_.cend();
+  }
+
+  const_iterator cbegin() {
+    return list_.cbegin();
+  }
+
+  const_iterator cend() {
+    return list_.cend();
+  }
+
+  const_iterator cbegin() const {
+    return list_.cbegin();
+  }
+
+  const_iterator cend() const {
+    return list_.cend();
+  }
+
+  reverse_iterator rbegin() {
+    return std::reverse_iterator<iterator>(end());
+  }
+
+  reverse_iterator rend() {
+    return std::reverse_iterator<iterator>(begin());
+  }
+
+  const_reverse_iterator rbegin() const {
+    return crbegin();
+  }
+
+  const_reverse_iterator rend() const {
+    return crend();
+  }
+
+  const_reverse_iterator crbegin() const {
+    return std::make_reverse_iterator(cend());
+  }
+
+  const_reverse_iterator crend() const {
+    return std::make_reverse_iterator(cbegin());
+  }
+
+  const_reverse_iterator crbegin() {
+    return std::reverse_iterator<const_iterator>(cend());
+  }
+
+  const_reverse_iterator crend() {
+    return std::reverse_iterator<const_iterator>(cbegin());
+  }
 
 
 
 
-  // ======================================================================================================================================================================
+
+
+
+  // ======================================================================================================================================================================
 
 
 
@@ -561,12 +1545,39 @@ class UnorderedMap {
   UnorderedMap()
       : alloc_(Alloc()),
         list_(alloc_),
-        buckets_(default_size_, list_.end(), alloc_),
+        buckets_(alloc_),
+        old_buckets_(alloc_),
         hashFunc_(Hash()),
-        equalFunc_(Equal()) {}
+        equalFunc_(Equal()) {
+    reset_buckets(default_size_);
+  }
+
+  UnorderedMap(const Alloc& allocator)
+      : alloc_(allocator),
+        list_(alloc_),
+        buckets_(alloc_),
+        old_buckets_(alloc_),
+        hashFunc_(Hash()),
+        equalFunc_(Equal()) {
+    reset_buckets(default_size_);
+  }
 
-  UnorderedMap(const Alloc& allocator): UnorderedMap() {
-    alloc_ = allocator;
+  // Builds the map in one pass: the table is sized once from size_hint (or from the distance of
+  // a forward range) and, with contiguous_nodes, all nodes come from a single allocation.
+  template<typename InputIterator>
+  UnorderedMap(InputIterator first, InputIterator last, size_t size_hint = 0, bool contiguous_nodes = false,
+               const Alloc& allocator = Alloc())
+      : UnorderedMap(allocator) {
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag,
+                                    typename std::iterator_traits<InputIterator>::iterator_category>) {
+      if (size_hint == 0) {
+        size_hint = static_cast<size_t>(std::distance(first, last));
+      }
+    }
+    if (contiguous_nodes) {
+      reserve_nodes(size_hint);
+    }
+    insert_range(first, last, size_hint);
   }
 
   ~UnorderedMap() {
@@ -577,8 +1588,11 @@ class UnorderedMap {
       : alloc_(std::move(other.alloc_)),
         list_(std::move(other.list_)),
         buckets_(std::move(other.buckets_)),
+        old_buckets_(alloc_),
         hashFunc_(std::move(other.hashFunc_)),
         equalFunc_(std::move(other.equalFunc_)),
+        policy_(other.policy_),
+        rehash_step_(other.rehash_step_),
         max_load_factor_(other.max_load_factor_)
   {
     rehash(buckets_.size());
@@ -590,6 +1604,8 @@ class UnorderedMap {
     buckets_ = std::move(other.buckets_);
     hashFunc_ = std::move(other.hashFunc_);
     equalFunc_ = std::move(other.equalFunc_);
+    policy_ = other.policy_;
+    rehash_step_ = other.rehash_step_;
     max_load_factor_ = other.max_load_factor_;
   }
 
@@ -604,13 +1620,16 @@ class UnorderedMap {
   }
 
   UnorderedMap(const UnorderedMap& other):
-        list_(other.list_),
+        alloc_(AllocTraits::select_on_container_copy_construction(other.alloc_)),
+        list_(alloc_),
+        buckets_(alloc_),
+        old_buckets_(alloc_),
         hashFunc_(other.hashFunc_),
         equalFunc_(other.equalFunc_),
+        rehash_step_(other.rehash_step_),
         max_load_factor_(other.max_load_factor_)
         {
-    alloc_ = AllocTraits::select_on_container_copy_construction(other.alloc_);
-    rehash(other.buckets_.size());
+    copy_nodes(other);
   }
 
   UnorderedMap& operator=(const UnorderedMap& other) {
@@ -619,6 +1638,7 @@ class UnorderedMap {
       alloc_ = other.alloc_;
     }
     swapMap(temp);
+    rehash(buckets_.size());
     return *this;
   }
 
@@ -638,8 +1658,7 @@ class UnorderedMap {
 
   void clear() {
     list_.clear();
-    buckets_.clear();
-    buckets_.resize(default_size_);
+    reset_buckets(default_size_);
   }
 
   void reserve(size_t n) {
@@ -650,86 +1669,114 @@ class UnorderedMap {
     rehash(new_bucket_count);
   }
 
-  size_t size() {
+  size_t size() const {
     return list_.size();
   }
 
+  bool empty() const {
+    return list_.size() == 0;
+  }
+
   iterator find(const Key& key) {
-    size_t hash = hashFunc_(key) % buckets_.size();
-    auto it = buckets_[hash];
-    while (it != list_.end() and (hashFunc_(it->first) % buckets_.size()) == hash) {
-      if (equalFunc_(it->first, key)) {
-        break;
-      }
-      ++it;
-    }
-    if (it != list_.end() and equalFunc_(it->first, key)) {
-      return it;
-    }
-    return list_.end();
+    return iterator(count_lookup(find_node(key, hashFunc_(key))));
   }
 
   const_iterator find(const Key& key) const {
-    if (list_.size() == 0) {
-      return list_.end();
-    }
-    size_t hash = hashFunc_(key) % buckets_.size();
-    auto it = buckets_[hash];
-    while (it != list_.end() and hashFunc_(it->first) == hash) {
-      if (equalFunc_(it->first, key)) {
-        break;
-      }
-      ++it;
-    }
-    if (it != list_.end() and equalFunc_(it->first, key)) {
-      return it;
-    }
-    return list_.end();
+    return const_iterator(count_lookup(find_node(key, hashFunc_(key))));
+  }
+
+  size_t count(const Key& key) const {
+    return find(key) != end();
+  }
+
+  bool contains(const Key& key) const {
+    return find(key) != end();
   }
 
   Value& operator[](const Key& key) {
+    return try_emplace(key).first->second;
+  }
+
+  Value& operator[](Key&& key) {
+    return try_emplace(std::move(key)).first->second;
+  }
+
+  template<typename K, typename = enable_if_transparent<K>>
+  iterator find(const K& key) {
+    return iterator(count_lookup(find_node(key, hashFunc_(key))));
+  }
+
+  template<typename K, typename = enable_if_transparent<K>>
+  const_iterator find(const K& key) const {
+    return const_iterator(count_lookup(find_node(key, hashFunc_(key))));
+  }
+
+  template<typename K, typename = enable_if_transparent<K>>
+  size_t count(const K& key) const {
+    return find(key) != end();
+  }
+
+  template<typename K, typename = enable_if_transparent<K>>
+  bool contains(const K& key) const {
+    return find(key) != end();
+  }
+
+  // Looks up [first, last) and writes one iterator per key to out. Keys are processed in groups of
+  // 128 in stages (slots, chain heads, the rest of the chains), so the cache misses of a group
+  // overlap instead of serializing. bench/find_batch.cpp compares it with find().
+  template<typename ForwardIt, typename OutputIt>
+  OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) {
+    find_batch_impl(first, last, [&out](BaseNode* node) { *out++ = iterator(node); });
+    return out;
+  }
+
+  template<typename ForwardIt, typename OutputIt>
+  OutputIt find_batch(ForwardIt first, ForwardIt last, OutputIt out) const {
+    find_batch_impl(first, last, [&out](BaseNode* node) { *out++ = const_iterator(node); });
+    return out;
+  }
+
+  template<typename Keys, typename Iterators>
+  void find_batch(const Keys& keys, Iterators& out_iterators) {
+    out_iterators.resize(keys.size());
+    find_batch(keys.begin(), keys.end(), out_iterators.begin());
+  }
+
+  template<typename Keys, typename Iterators>
+  void find_batch(const Keys& keys, Iterators& out_iterators) const {
+    out_iterators.resize(keys.size());
+    find_batch(keys.begin(), keys.end(), out_iterators.begin());
+  }
+
+  Value& at(const Key& key) {
     auto it = find(key);
-    size_t hash = hashFunc_(key) % buckets_.size();
-    if (it != list_.end()) {
+    if (it != end()) {
       return it->second;
     }
-    if (buckets_[hash] != list_.end()) {
-      list_.insert(buckets_[hash], NodeType(key, Value()));
-      --buckets_[hash];
-    } else {
-      list_.push_back(NodeType(std::move(key), Value()));
-    }
-    check_for_rehash();
-    return buckets_[hash]->second;
+    throw(std::out_of_range("out of range"));
   }
 
-  Value& operator[](Key&& key) {
+  const Value& at(const Key& key) const {
     auto it = find(key);
-    size_t hash = hashFunc_(key) % buckets_.size();
-    if (it != list_.end()) {
+    if (it != end()) {
       return it->second;
     }
-    if (buckets_[hash] != list_.end()) {
-      list_.insert(buckets_[hash], NodeType(std::move(key), Value()));
-    } else {
-      list_.push_back(NodeType(std::move(key), Value()));
-    }
-    --buckets_[hash];
-    check_for_rehash();
-    return buckets_[hash]->second;
+    throw(std::out_of_range("out of range"));
   }
 
-  Value& at(const Key& key) {
+  template<typename K, typename = enable_if_transparent<K>>
+  Value& at(const K& key) {
     auto it = find(key);
-    if (it != list_.end()) {
+    if (it != end()) {
       return it->second;
     }
     throw(std::out_of_range("out of range"));
   }
 
-  Value& at(const Key& key) const {
+  template<typename K, typename = enable_if_transparent<K>>
+  const Value& at(const K& key) const {
     auto it = find(key);
-    if (it != list_.end()) {
+    if (it != end()) {
       return it->second;
     }
     throw(std::out_of_range("out of range"));
@@ -737,20 +1784,64 @@ class UnorderedMap {
 
   template<typename... Args>
   std::pair<iterator, bool> emplace(Args&&... args) {
-    List<NodeType, NodeTypeAlloc> lst;
-    lst.emplace(lst.begin(), std::forward<Args>(args)...);
-    auto find_result = find(lst.begin()->first);
-    if (find_result != list_.end()) {
-      return {find_result, false};
-    }
-    size_t hash = hashFunc_(lst.begin()->first) % buckets_.size();
-    if (buckets_[hash] != list_.end()) {
-      list_.emplace(buckets_[hash], std::forward<Args>(args)...);
-    } else {
-      list_.emplace(list_.end(), std::forward<Args>(args)...);
+    BaseNode* node = list_.create_node(std::forward<Args>(args)...);
+    size_t hash;
+    BaseNode* found;
+    try {
+      const Key& key = static_cast<Node*>(node)->value.first;
+      hash = hashFunc_(key);
+      found = find_node(key, hash);
+    } catch (...) {
+      list_.destroy_node(node);
+      throw;
+    }
+    if (found != end_node()) {
+      list_.destroy_node(node);
+      return {iterator(found), false};
     }
+    link_new_node(node, hash);
     check_for_rehash();
-    return {--buckets_[hash], true};
+    return {iterator(node), true};
+  }
+
+  template<typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+    size_t hash = hashFunc_(key);
+    BaseNode* node = find_node(key, hash);
+    if (node != end_node()) {
+      return {iterator(node), false};
+    }
+    return {iterator(emplace_node(hash, std::piecewise_construct, std::forward_as_tuple(key),
+                                  std::forward_as_tuple(std::forward<Args>(args)...))), true};
+  }
+
+  template<typename... Args>
+  std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+    size_t hash = hashFunc_(key);
+    BaseNode* node = find_node(key, hash);
+    if (node != end_node()) {
+      return {iterator(node), false};
+    }
+    return {iterator(emplace_node(hash, std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+                                  std::forward_as_tuple(std::forward<Args>(args)...))), true};
+  }
+
+  template<typename M>
+  std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj) {
+    auto result = try_emplace(key, std::forward<M>(obj));
+    if (!result.second) {
+      result.first->second = std::forward<M>(obj);
+    }
+    return result;
+  }
+
+  template<typename M>
+  std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj) {
+    auto result = try_emplace(std::move(key), std::forward<M>(obj));
+    if (!result.second) {
+      result.first->second = std::forward<M>(obj);
+    }
+    return result;
   }
 
   std::pair<iterator, bool> insert(const NodeType& node) {
@@ -764,22 +1855,118 @@ class UnorderedMap {
 
   template<class InputIterator>
   void insert(InputIterator first, InputIterator last) {
-    while (first != last) {
-      emplace(*first);
-      ++first;
-    }
+    insert_range(first, last);
   }
 
-  void erase(const_iterator position) {
-    size_t hash = hashFunc_(position->first) % buckets_.size();
-    iterator temp = buckets_[hash];
-    ++temp;
-    if (buckets_[hash] == position and temp != list_.end() and hashFunc_(temp->first) % buckets_.size() == hash) {
-      ++buckets_[hash];
+  // Like insert(first, last), but reserves for size_hint more elements up front and hashes keys
+  // in groups with the bucket slots prefetched. The load factor is still checked after every
+  // group (every element for input iterators), so a missing or low hint only costs the usual
+  // geometric growth. Elements without a Key as .first, such as pairs that only convert to
+  // NodeType, are emplaced one by one.
+  template<class InputIterator>
+  void insert_range(InputIterator first, InputIterator last, size_t size_hint = 0) {
+    using category = typename std::iterator_traits<InputIterator>::iterator_category;
+    if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>) {
+      if (size_hint == 0) {
+        size_hint = static_cast<size_t>(std::distance(first, last));
+      }
+    }
+    reserve(size() + size_hint);
+    if constexpr (!iterator_has_key<InputIterator, Key>::value) {
+      for (; first != last; ++first) {
+        emplace(*first);
+      }
+    } else if constexpr (std::is_base_of_v<std::forward_iterator_tag, category>) {
+      static constexpr size_t group_size = 16;
+      size_t hashes[group_size];
+      while (first != last) {
+        InputIterator group = first;
+        size_t count = 0;
+        for (; count < group_size && first != last; ++count, ++first) {
+          hashes[count] = hashFunc_((*first).first);
+          prefetch_read(&bucket_slot(hashes[count]));
+        }
+        for (size_t i = 0; i < count; ++i, ++group) {
+          insert_hashed(hashes[i], *group);
+        }
+        check_for_rehash();
+      }
     } else {
-      buckets_[hash] = list_.end();
+      for (; first != last; ++first) {
+        auto&& item = *first;
+        insert_hashed(hashFunc_(item.first), std::forward<decltype(item)>(item));
+        check_for_rehash();
+      }
+    }
+    if (static_cast<float>(list_.size()) > static_cast<float>(buckets_.size()) * max_load_factor_) {
+      rehash(static_cast<size_t>(std::ceil(static_cast<float>(list_.size()) / max_load_factor_)));
     }
-    list_.erase(position);
+  }
+
+  // Bulk insertion for very large inputs: the nodes are created on the calling thread, then
+  // hashed, partitioned by bucket range and linked on threads threads (0 means one per hardware
+  // thread) together with the existing ones. Hash and Equal must be safe to call concurrently.
+  template<class InputIterator>
+  void parallel_insert_range(InputIterator first, InputIterator last, size_t threads = 0) {
+    std::vector<BaseNode*> added;
+    try {
+      for (; first != last; ++first) {
+        added.push_back(nullptr);
+        added.back() = list_.create_node(*first);
+      }
+    } catch (...) {
+      for (BaseNode* node : added) {
+        if (node != nullptr) {
+          list_.destroy_node(node);
+        }
+      }
+      throw;
+    }
+    size_t total = size() + added.size();
+    threads = parallel_threads(threads, total);
+    if (threads == 1) {
+      reserve(total);
+      for (BaseNode* node : added) {
+        size_t hash = hashFunc_(static_cast<Node*>(node)->value.first);
+        if (find_node(static_cast<Node*>(node)->value.first, hash) == end_node()) {
+          link_new_node(node, hash);
+        } else {
+          list_.destroy_node(node);
+        }
+      }
+      return;
+    }
+#ifdef UNORDERED_MAP_STATS
+    auto started = std::chrono::steady_clock::now();
+#endif
+    run_parallel(threads, [&](size_t t) {
+      for (size_t i = t * added.size() / threads; i < (t + 1) * added.size() / threads; ++i) {
+        set_node_hash(added[i], hashFunc_(static_cast<Node*>(added[i])->value.first));
+      }
+    });
+    size_t n = std::max(buckets_.size(), static_cast<size_t>(std::ceil(static_cast<double>(total) / max_load_factor_)));
+    drop_old_buckets();
+    BaseNode* duplicates = relink_parallel(added, policy_.bucket_count(n), threads);
+    while (duplicates != nullptr) {
+      BaseNode* next = duplicates->next;
+      list_.destroy_node(duplicates);
+      duplicates = next;
+    }
+#ifdef UNORDERED_MAP_STATS
+    ++stats_.rehash_count;
+    stats_.rehash_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+#endif
+  }
+
+  // Preallocates one contiguous block for n more nodes; later insertions take nodes from it.
+  void reserve_nodes(size_t n) {
+    list_.reserve_nodes(n);
+  }
+
+  void erase(const_iterator position) {
+    BaseNode* node = position.get_node_ptr();
+    unlink_node(node);
+    list_.destroy_node(node);
   }
 
   void erase(const_iterator first, const_iterator last) {
@@ -788,20 +1975,2783 @@ class UnorderedMap {
     }
   }
 
-  float load_factor() const {
-    return list_.size() / buckets_.size();
+  size_t erase(const Key& key) {
+    auto it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+    erase(it);
+    return 1;
   }
 
-  float max_load_factor() const noexcept {
-    return max_load_factor_;
+  template<typename K, typename = enable_if_transparent<K>>
+  size_t erase(const K& key) {
+    auto it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+    erase(it);
+    return 1;
   }
 
-  void max_load_factor (float new_max_load) {
-    max_load_factor_ = new_max_load;
+  node_type extract(const_iterator position) {
+    BaseNode* node = position.get_node_ptr();
+    unlink_node(node);
+    return node_type(node, list_.node_allocator_, list_.detach_node(static_cast<Node*>(node)));
   }
 
-  void swap(UnorderedMap& ump) {
-    std::swap(alloc_, ump.alloc);
-    swapMap(ump);
+  node_type extract(const Key& key) {
+    auto it = find(key);
+    if (it == end()) {
+      return node_type();
+    }
+    return extract(it);
   }
-};
+
+  insert_return_type insert(node_type&& handle) {
+    if (handle.empty()) {
+      return {end(), false, node_type()};
+    }
+    size_t hash = hashFunc_(handle.key());
+    BaseNode* found = find_node(handle.key(), hash);
+    if (found != end_node()) {
+      return {iterator(found), false, std::move(handle)};
+    }
+    list_.adopt_node(handle.store_);
+    BaseNode* node = handle.release();
+    handle.store_ = nullptr;
+    link_new_node(node, hash);
+    check_for_rehash();
+    return {iterator(node), true, node_type()};
+  }
+
+  // Moves every element whose key is not present here out of source, relinking the nodes.
+  void merge(UnorderedMap& source) {
+    if (&source == this) {
+      return;
+    }
+    BaseNode* node = source.list_.fakeNode_.next;
+    while (node != source.end_node()) {
+      BaseNode* next = node->next;
+      size_t hash = source.node_hash(node);
+      if (find_node(static_cast<Node*>(node)->value.first, hash) == end_node()) {
+        source.unlink_node(node);
+        list_.adopt_node(source.list_.detach_node(static_cast<Node*>(node)));
+        link_new_node(node, hash);
+        check_for_rehash();
+      }
+      node = next;
+    }
+  }
+
+  void merge(UnorderedMap&& source) {
+    merge(source);
+  }
+
+  // Recycles nodes through slabs of first_chunk, 2 * first_chunk, ... nodes instead of allocating
+  // each one; erased nodes are reused by later insertions. Zero stops growing the pool.
+  void enable_node_pool(size_t first_chunk = 64) {
+    list_.set_pool_chunk(first_chunk);
+  }
+
+  float load_factor() const {
+    return static_cast<float>(list_.size()) / static_cast<float>(buckets_.size());
+  }
+
+  size_t bucket_count() const {
+    return buckets_.size();
+  }
+
+  size_t bucket(const Key& key) const {
+    return bucket_index(hashFunc_(key));
+  }
+
+  // Number of elements in bucket i of the current table; elements still waiting for an
+  // incremental rehash are not counted.
+  size_t bucket_size(size_t i) const {
+    size_t result = 0;
+    for (BaseNode* node = buckets_[i].get_node_ptr(); node != end_node(); node = node->next) {
+      size_t hash = node_hash(node);
+      if (bucket_index(hash) != i || !in_new_table(hash)) {
+        break;
+      }
+      ++result;
+    }
+    return result;
+  }
+
+  UnorderedMapStats stats() const {
+    UnorderedMapStats result;
+#ifdef UNORDERED_MAP_STATS
+    result = stats_;
+    result.lookup_hits = lookup_hits_.load();
+    result.lookup_misses = lookup_misses_.load();
+#endif
+    result.size = size();
+    result.bucket_count = bucket_count();
+    result.load_factor = load_factor();
+    size_t chained = 0;
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+      size_t length = bucket_size(i);
+      if (length == 0) {
+        ++result.empty_buckets;
+      }
+      chained += length;
+      result.max_chain_length = std::max(result.max_chain_length, length);
+    }
+    size_t used = result.bucket_count - result.empty_buckets;
+    result.average_chain_length = used == 0 ? 0 : static_cast<double>(chained) / static_cast<double>(used);
+    result.empty_bucket_ratio = static_cast<double>(result.empty_buckets) / static_cast<double>(result.bucket_count);
+    return result;
+  }
+
+  void reset_stats() {
+#ifdef UNORDERED_MAP_STATS
+    stats_ = UnorderedMapStats();
+    lookup_hits_.reset();
+    lookup_misses_.reset();
+#endif
+  }
+
+  float max_load_factor() const noexcept {
+    return max_load_factor_;
+  }
+
+  void max_load_factor (float new_max_load) {
+    max_load_factor_ = new_max_load;
+  }
+
+  // With a non-zero step, growing the table no longer relinks every node at once: the old bucket
+  // array is kept and each later insertion migrates buckets_per_insert of its buckets, or more
+  // when that is needed to finish before the table grows again.
+  // Zero (the default) restores the stop-the-world rehash and finishes any pending migration.
+  void incremental_rehash(size_t buckets_per_insert) {
+    rehash_step_ = buckets_per_insert;
+    if (rehash_step_ == 0) {
+      migrate_buckets(old_buckets_.size());
+    }
+  }
+
+  bool rehashing() const {
+    return migrating();
+  }
+
+  // Rebuilds the table with at least n buckets, relinking the nodes on threads threads (0 means
+  // one per hardware thread). Maps too small to benefit are rehashed on the calling thread.
+  void parallel_rehash(size_t n, size_t threads = 0) {
+    n = std::max(n, static_cast<size_t>(std::ceil(static_cast<double>(size()) / max_load_factor_)));
+    threads = parallel_threads(threads, size());
+    if (threads == 1) {
+      rehash(n);
+      return;
+    }
+#ifdef UNORDERED_MAP_STATS
+    auto started = std::chrono::steady_clock::now();
+#endif
+    drop_old_buckets();
+    relink_parallel({}, policy_.bucket_count(n), threads);
+#ifdef UNORDERED_MAP_STATS
+    ++stats_.rehash_count;
+    stats_.rehash_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+#endif
+  }
+
+  FrozenMap<Key, Value, Hash, Equal> freeze() const {
+    return FrozenMap<Key, Value, Hash, Equal>(begin(), end(), size(), hashFunc_, equalFunc_);
+  }
+
+  // Writes a snapshot that load_mmap() can query in place; see MappedUnorderedMap for the layout.
+  void save(const std::string& path) const {
+    MappedUnorderedMap<Key, Value, Hash, Equal>::write(path, begin(), end(), size(), hashFunc_);
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  static MappedUnorderedMap<Key, Value, Hash, Equal> load_mmap(const std::string& path, bool copy_on_write = false) {
+    return MappedUnorderedMap<Key, Value, Hash, Equal>(path, copy_on_write);
+  }
+#endif
+
+  void swap(UnorderedMap& ump) {
+    std::swap(alloc_, ump.alloc_);
+    std::swap(list_, ump.list_);
+    std::swap(buckets_, ump.buckets_);
+    std::swap(hashFunc_, ump.hashFunc_);
+    std::swap(equalFunc_, ump.equalFunc_);
+    std::swap(policy_, ump.policy_);
+    std::swap(rehash_step_, ump.rehash_step_);
+    std::swap(max_load_factor_, ump.max_load_factor_);
+    rehash(buckets_.size());
+    ump.rehash(ump.buckets_.size());
+  }
+};
+
+
+
+
+
+
+
+// ======================================================================================================================================================================
+
+
+
+
+
+
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value>>>
+class FlatUnorderedMap {
+ public:
+  using NodeType = std::pair<const Key, Value>;
+
+ private:
+  static constexpr int8_t empty_ = -128;
+  static constexpr int8_t deleted_ = -2;
+  static constexpr int8_t sentinel_ = -1;
+  static constexpr size_t group_width_ = 16;
+
+  struct Group {
+#ifdef __SSE2__
+    __m128i ctrl;
+    explicit Group(const int8_t* pos) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+    uint32_t match(int8_t h2) const {
+      return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)));
+    }
+    uint32_t match_empty() const {
+      return match(empty_);
+    }
+    uint32_t match_empty_or_deleted() const {
+      return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(sentinel_), ctrl)));
+    }
+#else
+    const int8_t* ctrl;
+    explicit Group(const int8_t* pos) : ctrl(pos) {}
+    uint32_t match(int8_t h2) const {
+      uint32_t mask = 0;
+      for (size_t i = 0; i < group_width_; ++i) {
+        mask |= static_cast<uint32_t>(ctrl[i] == h2) << i;
+      }
+      return mask;
+    }
+    uint32_t match_empty() const {
+      return match(empty_);
+    }
+    uint32_t match_empty_or_deleted() const {
+      uint32_t mask = 0;
+      for (size_t i = 0; i < group_width_; ++i) {
+        mask |= static_cast<uint32_t>(ctrl[i] < sentinel_) << i;
+      }
+      return mask;
+    }
+#endif
+  };
+
+  using CtrlAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<int8_t>;
+  using SlotAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<NodeType>;
+  using CtrlTraits = std::allocator_traits<CtrlAlloc>;
+  using SlotTraits = std::allocator_traits<SlotAlloc>;
+
+  Alloc alloc_;
+  CtrlAlloc ctrl_alloc_;
+  SlotAlloc slot_alloc_;
+  int8_t* ctrl_;
+  NodeType* slots_;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  size_t growth_left_ = 0;
+  Hash hashFunc_;
+  Equal equalFunc_;
+  float max_load_factor_ = 0.875;
+
+  static int8_t* empty_ctrl() {
+    static int8_t ctrl[group_width_ + 1] = {sentinel_};
+    return ctrl;
+  }
+
+  // Identity hashes such as std::hash<int> leave the high bits of sequential keys unchanged, which would put them
+  // all in a few groups, so every hash is mixed before it is split into group index and tag.
+  template<typename K>
+  size_t hash_of(const K& key) const {
+    uint64_t hash = static_cast<uint64_t>(hashFunc_(key)) * 11400714819323198485ull;
+    return static_cast<size_t>(hash ^ (hash >> 32));
+  }
+
+  static size_t h1(size_t hash) { return hash >> 7; }
+  static int8_t h2(size_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+
+  size_t max_size_for(size_t capacity) const {
+    return std::min(capacity - 1, static_cast<size_t>(capacity * max_load_factor_));
+  }
+
+  template<typename F>
+  size_t probe(size_t hash, F&& visit) const {
+    size_t group_mask = capacity_ / group_width_ - 1;
+    size_t group = h1(hash) & group_mask;
+    for (size_t step = 1;; ++step) {
+      size_t result = visit(group * group_width_, Group(ctrl_ + group * group_width_));
+      if (result != capacity_) {
+        return result;
+      }
+      group = (group + step) & group_mask;
+    }
+  }
+
+  template<typename K>
+  size_t find_index(const K& key, size_t hash) const {
+    if (capacity_ == 0) {
+      return capacity_;
+    }
+    return probe(hash, [&](size_t base, const Group& group) {
+      for (uint32_t mask = group.match(h2(hash)); mask; mask &= mask - 1) {
+        size_t index = base + __builtin_ctz(mask);
+        if (equalFunc_(slots_[index].first, key)) {
+          return index;
+        }
+      }
+      if (group.match_empty()) {
+        return capacity_ + 1;
+      }
+      return capacity_;
+    });
+  }
+
+  size_t find_insert_slot(size_t hash) const {
+    return probe(hash, [&](size_t base, const Group& group) {
+      uint32_t mask = group.match_empty_or_deleted();
+      return mask ? base + __builtin_ctz(mask) : capacity_;
+    });
+  }
+
+  void set_ctrl(size_t index, int8_t value) {
+    ctrl_[index] = value;
+  }
+
+  void allocate(size_t capacity) {
+    ctrl_ = CtrlTraits::allocate(ctrl_alloc_, capacity + group_width_);
+    std::memset(ctrl_, static_cast<unsigned char>(empty_), capacity + group_width_);
+    ctrl_[capacity] = sentinel_;
+    try {
+      slots_ = SlotTraits::allocate(slot_alloc_, capacity);
+    } catch (...) {
+      CtrlTraits::deallocate(ctrl_alloc_, ctrl_, capacity + group_width_);
+      throw;
+    }
+    capacity_ = capacity;
+    growth_left_ = max_size_for(capacity);
+  }
+
+  void deallocate() {
+    if (capacity_ != 0) {
+      CtrlTraits::deallocate(ctrl_alloc_, ctrl_, capacity_ + group_width_);
+      SlotTraits::deallocate(slot_alloc_, slots_, capacity_);
+    }
+    ctrl_ = empty_ctrl();
+    slots_ = nullptr;
+    capacity_ = 0;
+    growth_left_ = 0;
+  }
+
+  void destroy_slots() {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (ctrl_[i] >= 0) {
+        SlotTraits::destroy(slot_alloc_, slots_ + i);
+        ctrl_[i] = empty_;
+      }
+    }
+    size_ = 0;
+  }
+
+  void rehash(size_t new_capacity) {
+    int8_t* old_ctrl = ctrl_;
+    NodeType* old_slots = slots_;
+    size_t old_capacity = capacity_;
+    allocate(new_capacity);
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] >= 0) {
+        size_t hash = hash_of(old_slots[i].first);
+        size_t index = find_insert_slot(hash);
+        set_ctrl(index, h2(hash));
+        SlotTraits::construct(slot_alloc_, slots_ + index,
+                              std::move(const_cast<Key&>(old_slots[i].first)), std::move(old_slots[i].second));
+        SlotTraits::destroy(slot_alloc_, old_slots + i);
+      }
+    }
+    growth_left_ -= size_;
+    if (old_capacity != 0) {
+      CtrlTraits::deallocate(ctrl_alloc_, old_ctrl, old_capacity + group_width_);
+      SlotTraits::deallocate(slot_alloc_, old_slots, old_capacity);
+    }
+  }
+
+  static size_t capacity_for(size_t n, float max_load_factor) {
+    size_t capacity = group_width_;
+    while (static_cast<size_t>(capacity * max_load_factor) < n or capacity - 1 < n) {
+      capacity *= 2;
+    }
+    return capacity;
+  }
+
+  void rehash_and_grow_if_necessary() {
+    if (capacity_ == 0) {
+      rehash(group_width_);
+    } else if (size_ * 2 <= max_size_for(capacity_)) {
+      rehash(capacity_);
+    } else {
+      rehash(capacity_ * 2);
+    }
+  }
+
+  size_t prepare_insert(size_t hash) {
+    size_t index = capacity_ == 0 ? 0 : find_insert_slot(hash);
+    if (capacity_ == 0 or (growth_left_ == 0 and ctrl_[index] != deleted_)) {
+      rehash_and_grow_if_necessary();
+      index = find_insert_slot(hash);
+    }
+    if (ctrl_[index] == empty_) {
+      --growth_left_;
+    }
+    set_ctrl(index, h2(hash));
+    ++size_;
+    return index;
+  }
+
+  template<typename K, typename... Args>
+  std::pair<size_t, bool> try_emplace_index(K&& key, Args&&... args) {
+    size_t hash = hash_of(key);
+    size_t index = find_index(key, hash);
+    if (index < capacity_) {
+      return {index, false};
+    }
+    index = prepare_insert(hash);
+    try {
+      SlotTraits::construct(slot_alloc_, slots_ + index, std::piecewise_construct,
+                            std::forward_as_tuple(std::forward<K>(key)),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+    } catch (...) {
+      erase_ctrl(index);
+      throw;
+    }
+    return {index, true};
+  }
+
+  void erase_ctrl(size_t index) {
+    --size_;
+    size_t base = index & ~(group_width_ - 1);
+    if (Group(ctrl_ + base).match_empty()) {
+      set_ctrl(index, empty_);
+      ++growth_left_;
+    } else {
+      set_ctrl(index, deleted_);
+    }
+  }
+
+ public:
+  template<typename V>
+  struct base_iterator {
+   public:
+    using difference_type = ptrdiff_t;
+    using value_type = V;
+    using pointer = V*;
+    using reference = value_type&;
+    using iterator_category = std::forward_iterator_tag;
+
+   private:
+    const int8_t* ctrl_;
+    NodeType* slot_;
+
+    void skip_empty() {
+      while (*ctrl_ < sentinel_) {
+        ++ctrl_;
+        ++slot_;
+      }
+    }
+
+   public:
+    base_iterator() : ctrl_(nullptr), slot_(nullptr) {}
+    base_iterator(const int8_t* ctrl, NodeType* slot) : ctrl_(ctrl), slot_(slot) {
+      skip_empty();
+    }
+
+    value_type& operator*() const {
+      return *slot_;
+    }
+
+    value_type* operator->() const {
+      return slot_;
+    }
+
+    base_iterator& operator++() {
+      ++ctrl_;
+      ++slot_;
+      skip_empty();
+      return *this;
+    }
+
+    base_iterator operator++(int) {
+      auto temp = *this;
+      ++*this;
+      return temp;
+    }
+
+    NodeType* get_slot_ptr() const {
+      return slot_;
+    }
+
+    bool operator==(const base_iterator& b) const {
+      return ctrl_ == b.ctrl_;
+    }
+    bool operator!=(const base_iterator& b) const {
+      return ctrl_ != b.ctrl_;
+    }
+    operator base_iterator<const V>() const {
+      return base_iterator<const V>(ctrl_, slot_);
+    }
+  };
+
+  using iterator = base_iterator<NodeType>;
+  using const_iterator = base_iterator<const NodeType>;
+  using AllocTraits = typename std::allocator_traits<Alloc>;
+
+ private:
+  iterator iterator_at(size_t index) {
+    return iterator(ctrl_ + index, slots_ + index);
+  }
+
+  const_iterator iterator_at(size_t index) const {
+    return const_iterator(ctrl_ + index, slots_ + index);
+  }
+
+ public:
+  iterator begin() {
+    return iterator_at(0);
+  }
+
+  iterator end() {
+    return iterator_at(capacity_);
+  }
+
+  const_iterator begin() const {
+    return iterator_at(0);
+  }
+
+  const_iterator end() const {
+    return iterator_at(capacity_);
+  }
+
+  const_iterator cbegin() const {
+    return begin();
+  }
+
+  const_iterator cend() const {
+    return end();
+  }
+
+  FlatUnorderedMap()
+      : alloc_(Alloc()),
+        ctrl_alloc_(alloc_),
+        slot_alloc_(alloc_),
+        ctrl_(empty_ctrl()),
+        slots_(nullptr),
+        hashFunc_(Hash()),
+        equalFunc_(Equal()) {}
+
+  FlatUnorderedMap(const Alloc& allocator)
+      : alloc_(allocator),
+        ctrl_alloc_(alloc_),
+        slot_alloc_(alloc_),
+        ctrl_(empty_ctrl()),
+        slots_(nullptr),
+        hashFunc_(Hash()),
+        equalFunc_(Equal()) {}
+
+  ~FlatUnorderedMap() {
+    destroy_slots();
+    deallocate();
+  }
+
+  FlatUnorderedMap(const FlatUnorderedMap& other)
+      : alloc_(AllocTraits::select_on_container_copy_construction(other.alloc_)),
+        ctrl_alloc_(alloc_),
+        slot_alloc_(alloc_),
+        ctrl_(empty_ctrl()),
+        slots_(nullptr),
+        hashFunc_(other.hashFunc_),
+        equalFunc_(other.equalFunc_),
+        max_load_factor_(other.max_load_factor_) {
+    reserve(other.size_);
+    try {
+      insert(other.begin(), other.end());
+    } catch (...) {
+      destroy_slots();
+      deallocate();
+      throw;
+    }
+  }
+
+  FlatUnorderedMap(FlatUnorderedMap&& other) noexcept
+      : alloc_(std::move(other.alloc_)),
+        ctrl_alloc_(std::move(other.ctrl_alloc_)),
+        slot_alloc_(std::move(other.slot_alloc_)),
+        ctrl_(other.ctrl_),
+        slots_(other.slots_),
+        capacity_(other.capacity_),
+        size_(other.size_),
+        growth_left_(other.growth_left_),
+        hashFunc_(std::move(other.hashFunc_)),
+        equalFunc_(std::move(other.equalFunc_)),
+        max_load_factor_(other.max_load_factor_) {
+    other.ctrl_ = empty_ctrl();
+    other.slots_ = nullptr;
+    other.capacity_ = 0;
+    other.size_ = 0;
+    other.growth_left_ = 0;
+  }
+
+  FlatUnorderedMap& operator=(FlatUnorderedMap other) {
+    swap(other);
+    return *this;
+  }
+
+  void swap(FlatUnorderedMap& other) {
+    std::swap(alloc_, other.alloc_);
+    std::swap(ctrl_alloc_, other.ctrl_alloc_);
+    std::swap(slot_alloc_, other.slot_alloc_);
+    std::swap(ctrl_, other.ctrl_);
+    std::swap(slots_, other.slots_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(size_, other.size_);
+    std::swap(growth_left_, other.growth_left_);
+    std::swap(hashFunc_, other.hashFunc_);
+    std::swap(equalFunc_, other.equalFunc_);
+    std::swap(max_load_factor_, other.max_load_factor_);
+  }
+
+  void clear() {
+    destroy_slots();
+    growth_left_ = capacity_ == 0 ? 0 : max_size_for(capacity_);
+  }
+
+  void reserve(size_t n) {
+    size_t capacity = capacity_for(n, max_load_factor_);
+    if (capacity > capacity_) {
+      rehash(capacity);
+    }
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  iterator find(const Key& key) {
+    size_t index = find_index(key, hash_of(key));
+    return index < capacity_ ? iterator_at(index) : end();
+  }
+
+  const_iterator find(const Key& key) const {
+    size_t index = find_index(key, hash_of(key));
+    return index < capacity_ ? iterator_at(index) : end();
+  }
+
+  size_t count(const Key& key) const {
+    return find(key) != end();
+  }
+
+  Value& operator[](const Key& key) {
+    size_t index = try_emplace_index(key).first;
+    return slots_[index].second;
+  }
+
+  Value& operator[](Key&& key) {
+    size_t index = try_emplace_index(std::move(key)).first;
+    return slots_[index].second;
+  }
+
+  Value& at(const Key& key) {
+    auto it = find(key);
+    if (it != end()) {
+      return it->second;
+    }
+    throw(std::out_of_range("out of range"));
+  }
+
+  const Value& at(const Key& key) const {
+    auto it = find(key);
+    if (it != end()) {
+      return it->second;
+    }
+    throw(std::out_of_range("out of range"));
+  }
+
+  template<typename K, typename V>
+  std::pair<iterator, bool> emplace(K&& key, V&& value) {
+    if constexpr (std::is_same<std::decay_t<K>, Key>::value) {
+      auto result = try_emplace_index(std::forward<K>(key), std::forward<V>(value));
+      return {iterator_at(result.first), result.second};
+    } else {
+      return emplace(NodeType(std::forward<K>(key), std::forward<V>(value)));
+    }
+  }
+
+  template<typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    alignas(NodeType) unsigned char buffer[sizeof(NodeType)];
+    NodeType* temp = reinterpret_cast<NodeType*>(buffer);
+    SlotTraits::construct(slot_alloc_, temp, std::forward<Args>(args)...);
+    try {
+      auto result = try_emplace_index(std::move(const_cast<Key&>(temp->first)), std::move(temp->second));
+      SlotTraits::destroy(slot_alloc_, temp);
+      return {iterator_at(result.first), result.second};
+    } catch (...) {
+      SlotTraits::destroy(slot_alloc_, temp);
+      throw;
+    }
+  }
+
+  template<typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args) {
+    auto result = try_emplace_index(key, std::forward<Args>(args)...);
+    return {iterator_at(result.first), result.second};
+  }
+
+  template<typename... Args>
+  std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args) {
+    auto result = try_emplace_index(std::move(key), std::forward<Args>(args)...);
+    return {iterator_at(result.first), result.second};
+  }
+
+  template<typename M>
+  std::pair<iterator, bool> insert_or_assign(const Key& key, M&& obj) {
+    auto result = try_emplace(key, std::forward<M>(obj));
+    if (!result.second) {
+      result.first->second = std::forward<M>(obj);
+    }
+    return result;
+  }
+
+  template<typename M>
+  std::pair<iterator, bool> insert_or_assign(Key&& key, M&& obj) {
+    auto result = try_emplace(std::move(key), std::forward<M>(obj));
+    if (!result.second) {
+      result.first->second = std::forward<M>(obj);
+    }
+    return result;
+  }
+
+  std::pair<iterator, bool> insert(const NodeType& node) {
+    auto result = try_emplace_index(node.first, node.second);
+    return {iterator_at(result.first), result.second};
+  }
+
+  template<typename T>
+  std::pair<iterator, bool> insert(T&& node) {
+    return emplace(std::forward<T>(node));
+  }
+
+  template<class InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    while (first != last) {
+      emplace(*first);
+      ++first;
+    }
+  }
+
+  void erase(const_iterator position) {
+    size_t index = position.get_slot_ptr() - slots_;
+    SlotTraits::destroy(slot_alloc_, slots_ + index);
+    erase_ctrl(index);
+  }
+
+  void erase(const_iterator first, const_iterator last) {
+    while (first != last) {
+      erase(first++);
+    }
+  }
+
+  size_t erase(const Key& key) {
+    auto it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+    erase(it);
+    return 1;
+  }
+
+  float load_factor() const {
+    return capacity_ == 0 ? 0 : static_cast<float>(size_) / capacity_;
+  }
+
+  float max_load_factor() const noexcept {
+    return max_load_factor_;
+  }
+
+  void max_load_factor(float new_max_load) {
+    if (!(new_max_load > 0)) {
+      throw std::invalid_argument("max_load_factor must be positive");
+    }
+    max_load_factor_ = std::min(std::max(new_max_load, 0.125f), 0.875f);
+  }
+};
+
+
+
+
+
+
+
+// ======================================================================================================================================================================
+
+
+
+
+
+
+// Every shard is a plain UnorderedMap behind its own reader-writer lock. The shard is picked by
+// the high bits of a second multiplicative mix of the hash, so it stays independent of the bucket
+// index inside the shard. Values are only ever copied out or visited under the lock.
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value>>>
+class ConcurrentUnorderedMap {
+ public:
+  using MapType = UnorderedMap<Key, Value, Hash, Equal, Alloc>;
+
+ private:
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mutex;
+    MapType map;
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+  size_t shard_count_;
+  size_t shard_shift_;
+  Hash hashFunc_;
+
+  static size_t default_shard_count() {
+    size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    return 4 * threads;
+  }
+
+  Shard& shard_for(size_t hash) const {
+    if (shard_count_ == 1) {
+      return shards_[0];
+    }
+    return shards_[(static_cast<uint64_t>(hash) * 0xff51afd7ed558ccdULL) >> shard_shift_];
+  }
+
+ public:
+  explicit ConcurrentUnorderedMap(size_t shard_count = default_shard_count()) {
+    size_t bits = 0;
+    while ((size_t(1) << bits) < shard_count) {
+      ++bits;
+    }
+    shard_count_ = size_t(1) << bits;
+    shard_shift_ = 64 - bits;
+    shards_.reset(new Shard[shard_count_]);
+  }
+
+  ConcurrentUnorderedMap(const ConcurrentUnorderedMap&) = delete;
+  ConcurrentUnorderedMap& operator=(const ConcurrentUnorderedMap&) = delete;
+
+  size_t shard_count() const {
+    return shard_count_;
+  }
+
+  std::optional<Value> find(const Key& key) const {
+    size_t hash = hashFunc_(key);
+    Shard& shard = shard_for(hash);
+    std::shared_lock lock(shard.mutex);
+    auto* node = shard.map.find_node(key, hash);
+    if (node == shard.map.end_node()) {
+      return std::nullopt;
+    }
+    return static_cast<typename MapType::Node*>(node)->value.second;
+  }
+
+  bool contains(const Key& key) const {
+    size_t hash = hashFunc_(key);
+    Shard& shard = shard_for(hash);
+    std::shared_lock lock(shard.mutex);
+    return shard.map.find_node(key, hash) != shard.map.end_node();
+  }
+
+  // Calls f(const Value&) under the shard's shared lock; f must not touch this map.
+  template<typename F>
+  bool visit(const Key& key, F&& f) const {
+    size_t hash = hashFunc_(key);
+    Shard& shard = shard_for(hash);
+    std::shared_lock lock(shard.mutex);
+    auto* node = shard.map.find_node(key, hash);
+    if (node == shard.map.end_node()) {
+      return false;
+    }
+    f(static_cast<const typename MapType::Node*>(node)->value.second);
+    return true;
+  }
+
+  template<typename... Args>
+  bool try_emplace(const Key& key, Args&&... args) {
+    size_t hash = hashFunc_(key);
+    Shard& shard = shard_for(hash);
+    std::unique_lock lock(shard.mutex);
+    if (shard.map.find_node(key, hash) != shard.map.end_node()) {
+      return false;
+    }
+    shard.map.emplace_node(hash, std::piecewise_construct, std::forward_as_tuple(key),
+                           std::forward_as_tuple(std::forward<Args>(args)...));
+    return true;
+  }
+
+  bool insert(const Key& key, const Value& value) {
+    return try_emplace(key, value);
+  }
+
+  bool insert(const Key& key, Value&& value) {
+    return try_emplace(key, std::move(value));
+  }
+
+  template<typename M>
+  bool insert_or_assign(const Key& key, M&& obj) {
+    return upsert(key, [&obj](Value& value) { value = std::forward<M>(obj); }, std::forward<M>(obj));
+  }
+
+  // If the key is present calls f(Value&) under the exclusive lock, otherwise inserts a value
+  // constructed from args. Returns true if a new element was inserted.
+  template<typename F, typename... Args>
+  bool upsert(const Key& key, F&& f, Args&&... args) {
+    size_t hash = hashFunc_(key);
+    Shard& shard = shard_for(hash);
+    std::unique_lock lock(shard.mutex);
+    auto* node = shard.map.find_node(key, hash);
+    if (node != shard.map.end_node()) {
+      f(static_cast<typename MapType::Node*>(node)->value.second);
+      return false;
+    }
+    shard.map.emplace_node(hash, std::piecewise_construct, std::forward_as_tuple(key),
+                           std::forward_as_tuple(std::forward<Args>(args)...));
+    return true;
+  }
+
+  // Calls f(Value&) on the existing or a value-initialized element and returns a copy of the result.
+  template<typename F>
+  Value compute(const Key& key, F&& f) {
+    size_t hash = hashFunc_(key);
+    Shard& shard = shard_for(hash);
+    std::unique_lock lock(shard.mutex);
+    auto* node = shard.map.find_node(key, hash);
+    if (node == shard.map.end_node()) {
+      node = shard.map.emplace_node(hash, std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>());
+    }
+    Value& value = static_cast<typename MapType::Node*>(node)->value.second;
+    f(value);
+    return value;
+  }
+
+  template<typename F>
+  bool update(const Key& key, F&& f) {
+    size_t hash = hashFunc_(key);
+    Shard& shard = shard_for(hash);
+    std::unique_lock lock(shard.mutex);
+    auto* node = shard.map.find_node(key, hash);
+    if (node == shard.map.end_node()) {
+      return false;
+    }
+    f(static_cast<typename MapType::Node*>(node)->value.second);
+    return true;
+  }
+
+  bool erase(const Key& key) {
+    size_t hash = hashFunc_(key);
+    Shard& shard = shard_for(hash);
+    std::unique_lock lock(shard.mutex);
+    auto* node = shard.map.find_node(key, hash);
+    if (node == shard.map.end_node()) {
+      return false;
+    }
+    shard.map.erase(typename MapType::const_iterator(node));
+    return true;
+  }
+
+  // Visits the shards one after another; the result is not a snapshot of the whole map.
+  template<typename F>
+  void for_each(F&& f) const {
+    for (size_t i = 0; i < shard_count_; ++i) {
+      std::shared_lock lock(shards_[i].mutex);
+      for (const auto& item : shards_[i].map) {
+        f(item);
+      }
+    }
+  }
+
+  size_t size() const {
+    size_t result = 0;
+    for (size_t i = 0; i < shard_count_; ++i) {
+      std::shared_lock lock(shards_[i].mutex);
+      result += shards_[i].map.size();
+    }
+    return result;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  void reserve(size_t n) {
+    for (size_t i = 0; i < shard_count_; ++i) {
+      std::unique_lock lock(shards_[i].mutex);
+      shards_[i].map.reserve(n / shard_count_ + 1);
+    }
+  }
+
+  void clear() {
+    for (size_t i = 0; i < shard_count_; ++i) {
+      std::unique_lock lock(shards_[i].mutex);
+      shards_[i].map.clear();
+    }
+  }
+};
+
+
+
+
+
+
+
+// ======================================================================================================================================================================
+
+
+
+
+
+
+// Hash map for tables that are read far more often than they are written. Readers never take a
+// lock: find walks immutable nodes published with release stores and only bumps a striped reader
+// counter. Writers serialize on a mutex, replace nodes instead of mutating them and retire the
+// old ones; retired memory is freed after a two-phase epoch flip has drained all readers that
+// could still see it.
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>,
+          typename Alloc = std::allocator<std::pair<const Key, Value>>>
+class ReadMostlyHashMap {
+ public:
+  using NodeType = std::pair<const Key, Value>;
+
+ private:
+  struct Node {
+    template<typename... Args>
+    explicit Node(size_t node_hash, Args&&... args)
+        : hash(node_hash),
+          value(std::forward<Args>(args)...) {}
+
+    size_t hash;
+    NodeType value;
+    std::atomic<Node*> next{nullptr};
+  };
+
+  struct Table {
+    explicit Table(size_t n)
+        : count(n),
+          buckets(new std::atomic<Node*>[n]) {
+      policy.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        buckets[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    PowerOfTwoBucketPolicy policy;
+    size_t count;
+    std::unique_ptr<std::atomic<Node*>[]> buckets;
+  };
+
+  struct alignas(64) ReaderStripe {
+    std::atomic<size_t> active[2];
+  };
+
+  class ReadGuard {
+   public:
+    explicit ReadGuard(const ReadMostlyHashMap& map) {
+      size_t epoch = map.epoch_.load(std::memory_order_acquire);
+      counter_ = &map.readers_[stripe()].active[epoch & 1];
+      counter_->fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+
+    ~ReadGuard() {
+      counter_->fetch_sub(1, std::memory_order_release);
+    }
+
+   private:
+    std::atomic<size_t>* counter_;
+  };
+
+  using NodeAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<Node>;
+  using NodeTraits = std::allocator_traits<NodeAlloc>;
+
+  static constexpr size_t stripes_ = 64;
+  static constexpr size_t reclaim_batch_ = 64;
+  static const size_t default_size_ = 32;
+
+  NodeAlloc alloc_;
+  Hash hashFunc_;
+  Equal equalFunc_;
+  std::atomic<Table*> table_;
+  std::atomic<size_t> epoch_{0};
+  std::atomic<size_t> size_{0};
+  std::unique_ptr<ReaderStripe[]> readers_;
+  std::mutex write_mutex_;
+  std::vector<Node*> retired_nodes_;
+  std::vector<Table*> retired_tables_;
+  float max_load_factor_ = 1.0;
+
+  static size_t stripe() {
+    static std::atomic<size_t> next_stripe{0};
+    thread_local size_t index = next_stripe.fetch_add(1, std::memory_order_relaxed) % stripes_;
+    return index;
+  }
+
+  template<typename... Args>
+  Node* create_node(size_t hash, Args&&... args) {
+    Node* node = NodeTraits::allocate(alloc_, 1);
+    try {
+      NodeTraits::construct(alloc_, node, hash, std::forward<Args>(args)...);
+    } catch (...) {
+      NodeTraits::deallocate(alloc_, node, 1);
+      throw;
+    }
+    return node;
+  }
+
+  void destroy_node(Node* node) {
+    NodeTraits::destroy(alloc_, node);
+    NodeTraits::deallocate(alloc_, node, 1);
+  }
+
+  void destroy_table(Table* table, bool with_nodes) {
+    if (with_nodes) {
+      for (size_t i = 0; i < table->count; ++i) {
+        Node* node = table->buckets[i].load(std::memory_order_relaxed);
+        while (node != nullptr) {
+          Node* next = node->next.load(std::memory_order_relaxed);
+          destroy_node(node);
+          node = next;
+        }
+      }
+    }
+    delete table;
+  }
+
+  const Node* find_node(const Key& key, size_t hash) const {
+    Table* table = table_.load(std::memory_order_acquire);
+    Node* node = table->buckets[table->policy.index(hash)].load(std::memory_order_acquire);
+    while (node != nullptr) {
+      if (node->hash == hash && equalFunc_(node->value.first, key)) {
+        return node;
+      }
+      node = node->next.load(std::memory_order_acquire);
+    }
+    return nullptr;
+  }
+
+  // Writer side only: returns the link that points at the node with this key, or at nullptr.
+  std::atomic<Node*>* find_link(const Key& key, size_t hash) {
+    Table* table = table_.load(std::memory_order_relaxed);
+    std::atomic<Node*>* link = &table->buckets[table->policy.index(hash)];
+    Node* node = link->load(std::memory_order_relaxed);
+    while (node != nullptr && !(node->hash == hash && equalFunc_(node->value.first, key))) {
+      link = &node->next;
+      node = link->load(std::memory_order_relaxed);
+    }
+    return link;
+  }
+
+  void publish(Node* node) {
+    Table* table = table_.load(std::memory_order_relaxed);
+    std::atomic<Node*>& head = table->buckets[table->policy.index(node->hash)];
+    node->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    head.store(node, std::memory_order_release);
+    size_.store(size_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    check_for_rehash();
+  }
+
+  // Waits until every reader that started before the call has left its read section.
+  void synchronize() {
+    for (int phase = 0; phase < 2; ++phase) {
+      size_t old_epoch = epoch_.fetch_add(1, std::memory_order_seq_cst);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      for (size_t i = 0; i < stripes_; ++i) {
+        while (readers_[i].active[old_epoch & 1].load(std::memory_order_acquire) != 0) {
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+  void reclaim() {
+    if (retired_nodes_.empty() && retired_tables_.empty()) {
+      return;
+    }
+    synchronize();
+    for (Node* node : retired_nodes_) {
+      destroy_node(node);
+    }
+    for (Table* table : retired_tables_) {
+      destroy_table(table, true);
+    }
+    retired_nodes_.clear();
+    retired_tables_.clear();
+  }
+
+  void retire(Node* node) {
+    retired_nodes_.push_back(node);
+    if (retired_nodes_.size() >= reclaim_batch_) {
+      reclaim();
+    }
+  }
+
+  void check_for_rehash() {
+    Table* table = table_.load(std::memory_order_relaxed);
+    if (static_cast<float>(size_.load(std::memory_order_relaxed)) >
+        static_cast<float>(table->count) * max_load_factor_) {
+      rehash(2 * table->count);
+    }
+  }
+
+  // Readers may still walk the old table, so its nodes are copied rather than relinked.
+  void rehash(size_t n) {
+    Table* old_table = table_.load(std::memory_order_relaxed);
+    Table* new_table = new Table(PowerOfTwoBucketPolicy().bucket_count(n));
+    try {
+      for (size_t i = 0; i < old_table->count; ++i) {
+        for (Node* node = old_table->buckets[i].load(std::memory_order_relaxed); node != nullptr;
+             node = node->next.load(std::memory_order_relaxed)) {
+          Node* copy = create_node(node->hash, node->value);
+          std::atomic<Node*>& head = new_table->buckets[new_table->policy.index(node->hash)];
+          copy->next.store(head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+          head.store(copy, std::memory_order_relaxed);
+        }
+      }
+    } catch (...) {
+      destroy_table(new_table, true);
+      throw;
+    }
+    table_.store(new_table, std::memory_order_release);
+    retired_tables_.push_back(old_table);
+    reclaim();
+  }
+
+ public:
+  ReadMostlyHashMap()
+      : alloc_(Alloc()),
+        hashFunc_(Hash()),
+        equalFunc_(Equal()),
+        table_(new Table(default_size_)),
+        readers_(new ReaderStripe[stripes_]) {
+    for (size_t i = 0; i < stripes_; ++i) {
+      readers_[i].active[0].store(0, std::memory_order_relaxed);
+      readers_[i].active[1].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  ReadMostlyHashMap(const ReadMostlyHashMap&) = delete;
+  ReadMostlyHashMap& operator=(const ReadMostlyHashMap&) = delete;
+
+  ~ReadMostlyHashMap() {
+    for (Node* node : retired_nodes_) {
+      destroy_node(node);
+    }
+    for (Table* table : retired_tables_) {
+      destroy_table(table, true);
+    }
+    destroy_table(table_.load(std::memory_order_relaxed), true);
+  }
+
+  // Wait-free: a fixed number of atomic operations plus the walk of one chain.
+  std::optional<Value> find(const Key& key) const {
+    ReadGuard guard(*this);
+    const Node* node = find_node(key, hashFunc_(key));
+    if (node == nullptr) {
+      return std::nullopt;
+    }
+    return node->value.second;
+  }
+
+  bool contains(const Key& key) const {
+    ReadGuard guard(*this);
+    return find_node(key, hashFunc_(key)) != nullptr;
+  }
+
+  // Calls f(const Value&) inside the read section; the reference must not escape f.
+  template<typename F>
+  bool visit(const Key& key, F&& f) const {
+    ReadGuard guard(*this);
+    const Node* node = find_node(key, hashFunc_(key));
+    if (node == nullptr) {
+      return false;
+    }
+    f(node->value.second);
+    return true;
+  }
+
+  template<typename F>
+  void for_each(F&& f) const {
+    ReadGuard guard(*this);
+    Table* table = table_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < table->count; ++i) {
+      for (const Node* node = table->buckets[i].load(std::memory_order_acquire); node != nullptr;
+           node = node->next.load(std::memory_order_acquire)) {
+        f(node->value);
+      }
+    }
+  }
+
+  template<typename... Args>
+  bool try_emplace(const Key& key, Args&&... args) {
+    size_t hash = hashFunc_(key);
+    std::lock_guard lock(write_mutex_);
+    if (find_link(key, hash)->load(std::memory_order_relaxed) != nullptr) {
+      return false;
+    }
+    publish(create_node(hash, std::piecewise_construct, std::forward_as_tuple(key),
+                        std::forward_as_tuple(std::forward<Args>(args)...)));
+    return true;
+  }
+
+  bool insert(const Key& key, const Value& value) {
+    return try_emplace(key, value);
+  }
+
+  bool insert(const Key& key, Value&& value) {
+    return try_emplace(key, std::move(value));
+  }
+
+  // The stored node is replaced, so readers see either the old or the new value, never a mix.
+  template<typename M>
+  bool insert_or_assign(const Key& key, M&& obj) {
+    size_t hash = hashFunc_(key);
+    std::lock_guard lock(write_mutex_);
+    std::atomic<Node*>* link = find_link(key, hash);
+    Node* old = link->load(std::memory_order_relaxed);
+    Node* node = create_node(hash, key, std::forward<M>(obj));
+    if (old == nullptr) {
+      publish(node);
+      return true;
+    }
+    node->next.store(old->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    link->store(node, std::memory_order_release);
+    retire(old);
+    return false;
+  }
+
+  bool erase(const Key& key) {
+    size_t hash = hashFunc_(key);
+    std::lock_guard lock(write_mutex_);
+    std::atomic<Node*>* link = find_link(key, hash);
+    Node* node = link->load(std::memory_order_relaxed);
+    if (node == nullptr) {
+      return false;
+    }
+    link->store(node->next.load(std::memory_order_relaxed), std::memory_order_release);
+    size_.store(size_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    retire(node);
+    return true;
+  }
+
+  void clear() {
+    std::lock_guard lock(write_mutex_);
+    Table* old_table = table_.load(std::memory_order_relaxed);
+    table_.store(new Table(default_size_), std::memory_order_release);
+    size_.store(0, std::memory_order_relaxed);
+    retired_tables_.push_back(old_table);
+    reclaim();
+  }
+
+  void reserve(size_t n) {
+    std::lock_guard lock(write_mutex_);
+    size_t needed = static_cast<size_t>(std::ceil(static_cast<double>(n) / max_load_factor_));
+    if (needed > table_.load(std::memory_order_relaxed)->count) {
+      rehash(needed);
+    }
+  }
+
+  // Reclaims retired nodes now instead of waiting for the next full batch.
+  void collect() {
+    std::lock_guard lock(write_mutex_);
+    reclaim();
+  }
+
+  size_t size() const {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+};
+
+
+
+
+
+
+
+// ======================================================================================================================================================================
+
+
+
+
+
+
+inline uint64_t mix_hash(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// Read-only private mapping of a whole file; writes through data() stay copy-on-write.
+class MappedFile {
+ public:
+  MappedFile() = default;
+
+  explicit MappedFile(const std::string& path, bool writable = false) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("cannot open " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+      ::close(fd);
+      throw std::runtime_error("cannot stat " + path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ != 0) {
+      int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+      void* data = ::mmap(nullptr, size_, protection, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("cannot map " + path);
+      }
+      data_ = static_cast<char*>(data);
+    }
+    ::close(fd);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept
+      : data_(other.data_),
+        size_(other.size_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+  }
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      unmap();
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+    }
+    return *this;
+  }
+
+  ~MappedFile() {
+    unmap();
+  }
+
+  char* data() {
+    return data_;
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  char* data_ = nullptr;
+  size_t size_ = 0;
+
+  void unmap() {
+    if (data_ != nullptr) {
+      ::munmap(data_, size_);
+      data_ = nullptr;
+      size_ = 0;
+    }
+  }
+};
+#endif
+
+// Immutable map over a minimal perfect hash in the PTHash/CHD style: keys are split into buckets
+// of about three, and every bucket gets a pilot such that mix(hash + pilot * golden) % size sends
+// its keys to free slots. A lookup is one hash, one pilot load and one slot compare. The slots
+// are a single array of {key, value}, so for trivially copyable types the table can be saved and
+// mapped back with no rebuild; the Hash must then give the same values in every process.
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class FrozenMap {
+ public:
+  struct Entry {
+    Key first;
+    Value second;
+  };
+
+  using const_iterator = const Entry*;
+
+ private:
+  struct Header {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t size;
+    uint64_t bucket_count;
+    uint64_t key_size;
+    uint64_t value_size;
+    uint64_t slots_offset;
+    uint64_t seed;
+  };
+
+  static constexpr uint64_t magic_ = 0x50414d4e5a4f5246ULL;
+  static constexpr uint64_t version_ = 2;
+  static constexpr size_t bucket_load_ = 3;
+  static constexpr size_t max_seeds_ = 8;
+
+  std::vector<uint32_t> pilot_storage_;
+  std::vector<Entry> slot_storage_;
+#if defined(__unix__) || defined(__APPLE__)
+  MappedFile file_;
+#endif
+  const uint32_t* pilots_ = nullptr;
+  const Entry* slots_ = nullptr;
+  size_t size_ = 0;
+  size_t bucket_count_ = 1;
+  uint64_t seed_ = 0;
+  Hash hashFunc_;
+  Equal equalFunc_;
+
+  size_t bucket_of(uint64_t hash) const {
+    return (hash >> 32) % bucket_count_;
+  }
+
+  size_t slot_of(uint64_t hash, uint32_t pilot) const {
+    return mix_hash(hash + pilot * 0x9e3779b97f4a7c15ULL) % size_;
+  }
+
+  static size_t slot_alignment() {
+    return alignof(Entry) > alignof(uint64_t) ? alignof(Entry) : alignof(uint64_t);
+  }
+
+  uint64_t hash_of(const Key& key) const {
+    return mix_hash(hashFunc_(key) + seed_);
+  }
+
+  // Gives every bucket, largest first, the first pilot that moves all of its keys to free slots and
+  // records which item lands in each slot. Returns false if a bucket finds none within its attempts,
+  // which grow with the table because the last buckets have to hit one of a few free slots.
+  bool place(const std::vector<uint64_t>& hashes, std::vector<size_t>& source) {
+    std::vector<size_t> bucket_start(bucket_count_ + 1, 0);
+    for (size_t i = 0; i < size_; ++i) {
+      ++bucket_start[bucket_of(hashes[i]) + 1];
+    }
+    std::partial_sum(bucket_start.begin(), bucket_start.end(), bucket_start.begin());
+    std::vector<size_t> members(size_);
+    std::vector<size_t> cursor(bucket_start.begin(), bucket_start.end() - 1);
+    for (size_t i = 0; i < size_; ++i) {
+      members[cursor[bucket_of(hashes[i])]++] = i;
+    }
+    std::vector<size_t> order(bucket_count_);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&bucket_start](size_t lhs, size_t rhs) {
+      return bucket_start[lhs + 1] - bucket_start[lhs] > bucket_start[rhs + 1] - bucket_start[rhs];
+    });
+
+    uint64_t attempts = std::min<uint64_t>(uint64_t(64) * size_ + 65536, uint64_t(1) << 32);
+    pilot_storage_.assign(bucket_count_, 0);
+    std::vector<bool> taken(size_, false);
+    std::vector<size_t> positions;
+    for (size_t bucket : order) {
+      size_t from = bucket_start[bucket];
+      size_t to = bucket_start[bucket + 1];
+      if (from == to) {
+        break;
+      }
+      for (size_t i = from; i < to; ++i) {
+        for (size_t j = i + 1; j < to; ++j) {
+          if (hashes[members[i]] == hashes[members[j]]) {
+            throw std::invalid_argument("FrozenMap: duplicate keys or equal hashes");
+          }
+        }
+      }
+      bool placed = false;
+      for (uint64_t pilot = 0; pilot < attempts && !placed; ++pilot) {
+        positions.clear();
+        for (size_t i = from; i < to; ++i) {
+          size_t position = slot_of(hashes[members[i]], static_cast<uint32_t>(pilot));
+          if (taken[position] || std::find(positions.begin(), positions.end(), position) != positions.end()) {
+            break;
+          }
+          positions.push_back(position);
+        }
+        if (positions.size() == to - from) {
+          pilot_storage_[bucket] = static_cast<uint32_t>(pilot);
+          for (size_t i = from; i < to; ++i) {
+            taken[positions[i - from]] = true;
+            source[positions[i - from]] = members[i];
+          }
+          placed = true;
+        }
+      }
+      if (!placed) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void build(std::vector<Entry>& items) {
+    size_ = items.size();
+    bucket_count_ = std::max<size_t>((size_ + bucket_load_ - 1) / bucket_load_, 1);
+    pilot_storage_.assign(bucket_count_, 0);
+    pilots_ = pilot_storage_.data();
+    if (size_ == 0) {
+      return;
+    }
+    std::vector<uint64_t> hashes(size_);
+    std::vector<size_t> source(size_);
+    // A different seed gives every key new buckets and slots, so an unlucky layout is rebuilt
+    // from scratch rather than searched forever.
+    for (size_t round = 0;; ++round) {
+      for (size_t i = 0; i < size_; ++i) {
+        hashes[i] = hash_of(items[i].first);
+      }
+      if (place(hashes, source)) {
+        break;
+      }
+      if (round + 1 == max_seeds_) {
+        throw std::runtime_error("FrozenMap: no perfect hash found");
+      }
+      seed_ = mix_hash(seed_ + round + 1);
+    }
+    pilots_ = pilot_storage_.data();
+    slot_storage_.reserve(size_);
+    for (size_t position = 0; position < size_; ++position) {
+      slot_storage_.push_back(std::move(items[source[position]]));
+    }
+    slots_ = slot_storage_.data();
+  }
+
+ public:
+  FrozenMap() {
+    pilot_storage_.assign(1, 0);
+    pilots_ = pilot_storage_.data();
+  }
+
+  template<typename InputIterator>
+  FrozenMap(InputIterator first, InputIterator last, size_t size_hint = 0, const Hash& hash = Hash(),
+            const Equal& equal = Equal())
+      : hashFunc_(hash),
+        equalFunc_(equal) {
+    std::vector<Entry> items;
+    items.reserve(size_hint);
+    for (; first != last; ++first) {
+      items.push_back(Entry{(*first).first, (*first).second});
+    }
+    build(items);
+  }
+
+  FrozenMap(const FrozenMap&) = delete;
+  FrozenMap& operator=(const FrozenMap&) = delete;
+  FrozenMap(FrozenMap&&) noexcept = default;
+  FrozenMap& operator=(FrozenMap&&) noexcept = default;
+
+  const_iterator begin() const {
+    return slots_;
+  }
+
+  const_iterator end() const {
+    return slots_ + size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t bucket_count() const {
+    return bucket_count_;
+  }
+
+  const_iterator find(const Key& key) const {
+    if (size_ == 0) {
+      return end();
+    }
+    uint64_t hash = hash_of(key);
+    const Entry* entry = slots_ + slot_of(hash, pilots_[bucket_of(hash)]);
+    return equalFunc_(entry->first, key) ? entry : end();
+  }
+
+  size_t count(const Key& key) const {
+    return find(key) != end();
+  }
+
+  bool contains(const Key& key) const {
+    return find(key) != end();
+  }
+
+  const Value& at(const Key& key) const {
+    auto it = find(key);
+    if (it != end()) {
+      return it->second;
+    }
+    throw(std::out_of_range("out of range"));
+  }
+
+  void save(const std::string& path) const {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "only trivially copyable keys and values can be saved");
+    Header header{magic_, version_, size_, bucket_count_, sizeof(Key), sizeof(Value), 0, seed_};
+    size_t pilots_end = sizeof(Header) + bucket_count_ * sizeof(uint32_t);
+    size_t align = slot_alignment();
+    header.slots_offset = (pilots_end + align - 1) / align * align;
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(pilots_), static_cast<std::streamsize>(bucket_count_ * sizeof(uint32_t)));
+    std::vector<char> padding(header.slots_offset - pilots_end, 0);
+    out.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    // Entries are copied field by field into a zeroed buffer so that padding never reaches the file.
+    const size_t chunk = 4096;
+    std::vector<char> buffer(std::min(size_, chunk) * sizeof(Entry));
+    for (size_t start = 0; start < size_; start += chunk) {
+      size_t count = std::min(chunk, size_ - start);
+      std::memset(buffer.data(), 0, buffer.size());
+      for (size_t i = 0; i < count; ++i) {
+        const Entry& slot = slots_[start + i];
+        char* entry = buffer.data() + i * sizeof(Entry);
+        const char* base = reinterpret_cast<const char*>(&slot);
+        std::memcpy(entry + (reinterpret_cast<const char*>(&slot.first) - base), &slot.first, sizeof(Key));
+        std::memcpy(entry + (reinterpret_cast<const char*>(&slot.second) - base), &slot.second, sizeof(Value));
+      }
+      out.write(buffer.data(), static_cast<std::streamsize>(count * sizeof(Entry)));
+    }
+    if (!out) {
+      throw std::runtime_error("cannot write " + path);
+    }
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  // Maps a file written by save(); the table is used in place, nothing is copied or rebuilt.
+  static FrozenMap load(const std::string& path, const Hash& hash = Hash(), const Equal& equal = Equal()) {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                  "only trivially copyable keys and values can be loaded");
+    FrozenMap result;
+    result.hashFunc_ = hash;
+    result.equalFunc_ = equal;
+    result.file_ = MappedFile(path);
+    Header header;
+    if (result.file_.size() < sizeof(Header)) {
+      throw std::runtime_error("bad frozen map file " + path);
+    }
+    std::memcpy(&header, result.file_.data(), sizeof(Header));
+    if (header.magic != magic_ || header.version != version_ || header.key_size != sizeof(Key) ||
+        header.value_size != sizeof(Value) || header.bucket_count == 0 ||
+        header.slots_offset < sizeof(Header) + header.bucket_count * sizeof(uint32_t) ||
+        header.slots_offset % alignof(Entry) != 0 ||
+        result.file_.size() != header.slots_offset + header.size * sizeof(Entry)) {
+      throw std::runtime_error("bad frozen map file " + path);
+    }
+    result.size_ = header.size;
+    result.bucket_count_ = header.bucket_count;
+    result.seed_ = header.seed;
+    result.pilots_ = reinterpret_cast<const uint32_t*>(result.file_.data() + sizeof(Header));
+    result.slots_ = reinterpret_cast<const Entry*>(result.file_.data() + header.slots_offset);
+    return result;
+  }
+#endif
+};
+
+
+
+
+
+
+
+// ======================================================================================================================================================================
+
+
+
+
+
+
+// Query-only view of a snapshot written by UnorderedMap::save(). The file is position independent:
+// a header, bucket_count + 1 offsets in the CSR style and the entries {hash, key, value} grouped
+// by bucket, so a lookup reads two offsets and scans one short run. Only trivially copyable keys
+// and values can be stored, and the Hash must give the same values in every process. With
+// copy_on_write the mapping is private and writable: mutable_at() changes values in place, touched
+// pages are copied and the file itself never changes.
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class MappedUnorderedMap {
+ public:
+  struct Entry {
+    uint64_t hash;
+    Key first;
+    Value second;
+
+    operator std::pair<const Key, Value>() const {
+      return {first, second};
+    }
+  };
+
+  using const_iterator = const Entry*;
+
+ private:
+  static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<Value>,
+                "only trivially copyable keys and values can be mapped");
+
+  struct Header {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t size;
+    uint64_t bucket_count;
+    uint64_t key_size;
+    uint64_t value_size;
+    uint64_t offsets_offset;
+    uint64_t entries_offset;
+  };
+
+  static constexpr uint64_t magic_ = 0x50414d4e4f5253ULL;
+  static constexpr uint64_t version_ = 1;
+
+  static size_t align_up(size_t offset) {
+    size_t align = alignof(Entry) > alignof(uint64_t) ? alignof(Entry) : alignof(uint64_t);
+    return (offset + align - 1) / align * align;
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  MappedFile file_;
+#endif
+  const uint64_t* offsets_ = nullptr;
+  Entry* entries_ = nullptr;
+  size_t size_ = 0;
+  size_t bucket_count_ = 0;
+  bool writable_ = false;
+  PowerOfTwoBucketPolicy policy_;
+  Hash hashFunc_;
+  Equal equalFunc_;
+
+  Entry* find_entry(const Key& key) const {
+    uint64_t hash = hashFunc_(key);
+    size_t bucket = policy_.index(hash);
+    for (Entry* entry = entries_ + offsets_[bucket]; entry != entries_ + offsets_[bucket + 1]; ++entry) {
+      if (entry->hash == hash && equalFunc_(entry->first, key)) {
+        return entry;
+      }
+    }
+    return nullptr;
+  }
+
+ public:
+  template<typename ForwardIterator>
+  static void write(const std::string& path, ForwardIterator first, ForwardIterator last, size_t size,
+                    const Hash& hashFunc = Hash()) {
+    PowerOfTwoBucketPolicy policy;
+    size_t bucket_count = policy.bucket_count(std::max<size_t>(size, 1));
+    policy.resize(bucket_count);
+    std::vector<uint64_t> offsets(bucket_count + 1, 0);
+    size_t count = 0;
+    for (ForwardIterator it = first; it != last; ++it, ++count) {
+      ++offsets[policy.index(hashFunc((*it).first)) + 1];
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    Header header{magic_, version_, count, bucket_count, sizeof(Key), sizeof(Value), sizeof(Header), 0};
+    size_t offsets_end = header.offsets_offset + offsets.size() * sizeof(uint64_t);
+    header.entries_offset = align_up(offsets_end);
+    std::vector<char> padding(header.entries_offset - offsets_end, 0);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    out.write(padding.data(), padding.size());
+
+    // Entries go out a range of buckets at a time: each pass over the input copies the elements of
+    // the next buckets that fit in the buffer into a zeroed chunk, so padding never reaches the file
+    // and the whole table is never held in memory.
+    const size_t chunk = std::max<size_t>(1, (size_t(64) << 20) / sizeof(Entry));
+    std::vector<char> buffer;
+    std::vector<uint64_t> cursor;
+    for (size_t low = 0; low < bucket_count;) {
+      size_t high = low + 1;
+      while (high < bucket_count && offsets[high + 1] - offsets[low] <= chunk) {
+        ++high;
+      }
+      size_t entries = offsets[high] - offsets[low];
+      buffer.assign(entries * sizeof(Entry), 0);
+      cursor.assign(offsets.begin() + low, offsets.begin() + high);
+      for (ForwardIterator it = first; entries != 0 && it != last; ++it) {
+        uint64_t hash = hashFunc((*it).first);
+        size_t bucket = policy.index(hash);
+        if (bucket < low || bucket >= high) {
+          continue;
+        }
+        size_t index = cursor[bucket - low]++ - offsets[low];
+        Entry* entry = reinterpret_cast<Entry*>(buffer.data() + index * sizeof(Entry));
+        std::memcpy(static_cast<void*>(&entry->hash), &hash, sizeof(uint64_t));
+        std::memcpy(static_cast<void*>(&entry->first), &(*it).first, sizeof(Key));
+        std::memcpy(static_cast<void*>(&entry->second), &(*it).second, sizeof(Value));
+      }
+      out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      low = high;
+    }
+    if (!out) {
+      throw std::runtime_error("cannot write " + path);
+    }
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  explicit MappedUnorderedMap(const std::string& path, bool copy_on_write = false, const Hash& hash = Hash(),
+                              const Equal& equal = Equal())
+      : file_(path, copy_on_write),
+        writable_(copy_on_write),
+        hashFunc_(hash),
+        equalFunc_(equal) {
+    Header header;
+    if (file_.size() < sizeof(Header)) {
+      throw std::runtime_error("bad map snapshot " + path);
+    }
+    std::memcpy(&header, file_.data(), sizeof(Header));
+    if (header.magic != magic_ || header.version != version_ || header.key_size != sizeof(Key) ||
+        header.value_size != sizeof(Value) || header.bucket_count == 0 ||
+        (header.bucket_count & (header.bucket_count - 1)) != 0 || header.offsets_offset != sizeof(Header) ||
+        header.entries_offset < header.offsets_offset + (header.bucket_count + 1) * sizeof(uint64_t) ||
+        header.entries_offset % alignof(Entry) != 0 ||
+        file_.size() != header.entries_offset + header.size * sizeof(Entry)) {
+      throw std::runtime_error("bad map snapshot " + path);
+    }
+    size_ = header.size;
+    bucket_count_ = header.bucket_count;
+    policy_.resize(bucket_count_);
+    offsets_ = reinterpret_cast<const uint64_t*>(file_.data() + header.offsets_offset);
+    entries_ = reinterpret_cast<Entry*>(file_.data() + header.entries_offset);
+    // find_entry trusts the offsets, so a damaged file must not be able to point it outside the entries.
+    for (size_t bucket = 0; bucket < bucket_count_; ++bucket) {
+      if (offsets_[bucket] > offsets_[bucket + 1]) {
+        throw std::runtime_error("bad map snapshot " + path);
+      }
+    }
+    if (offsets_[bucket_count_] != size_) {
+      throw std::runtime_error("bad map snapshot " + path);
+    }
+  }
+#endif
+
+  MappedUnorderedMap(const MappedUnorderedMap&) = delete;
+  MappedUnorderedMap& operator=(const MappedUnorderedMap&) = delete;
+  MappedUnorderedMap(MappedUnorderedMap&&) noexcept = default;
+  MappedUnorderedMap& operator=(MappedUnorderedMap&&) noexcept = default;
+
+  const_iterator begin() const {
+    return entries_;
+  }
+
+  const_iterator end() const {
+    return entries_ + size_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  size_t bucket_count() const {
+    return bucket_count_;
+  }
+
+  const_iterator find(const Key& key) const {
+    Entry* entry = find_entry(key);
+    return entry == nullptr ? end() : entry;
+  }
+
+  size_t count(const Key& key) const {
+    return find(key) != end();
+  }
+
+  bool contains(const Key& key) const {
+    return find(key) != end();
+  }
+
+  const Value& at(const Key& key) const {
+    auto it = find(key);
+    if (it != end()) {
+      return it->second;
+    }
+    throw(std::out_of_range("out of range"));
+  }
+
+  // Only for maps loaded with copy_on_write; the change stays in this process.
+  Value& mutable_at(const Key& key) {
+    if (!writable_) {
+      throw std::logic_error("snapshot is mapped read-only");
+    }
+    Entry* entry = find_entry(key);
+    if (entry != nullptr) {
+      return entry->second;
+    }
+    throw(std::out_of_range("out of range"));
+  }
+};
+
+
+
+
+
+
+
+// ======================================================================================================================================================================
+
+
+
+
+
+
+struct CacheStats {
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t evictions = 0;
+
+  double hit_ratio() const {
+    size_t lookups = hits + misses;
+    return lookups == 0 ? 0 : static_cast<double>(hits) / static_cast<double>(lookups);
+  }
+
+  CacheStats& operator+=(const CacheStats& other) {
+    hits += other.hits;
+    misses += other.misses;
+    evictions += other.evictions;
+    return *this;
+  }
+};
+
+// Entries sit in a List in recency order and the UnorderedMap points at their nodes, so get, put
+// and eviction are O(1) and a hit hands out the stored value instead of a copy.
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class LruCache {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using hasher = Hash;
+
+ private:
+  using ListType = List<std::pair<const Key, Value>>;
+  using ListIterator = typename ListType::iterator;
+
+  size_t capacity_;
+  ListType entries_;
+  UnorderedMap<Key, ListIterator, Hash, Equal> index_;
+  CacheStats stats_;
+
+  void evict() {
+    auto victim = --entries_.end();
+    index_.erase(victim->first);
+    entries_.pop_back();
+    ++stats_.evictions;
+  }
+
+ public:
+  explicit LruCache(size_t capacity)
+      : capacity_(std::max<size_t>(capacity, 1)) {
+    index_.reserve(capacity_);
+  }
+
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+
+  // The pointer stays valid until the entry is evicted or erased.
+  Value* get(const Key& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      ++stats_.misses;
+      return nullptr;
+    }
+    ++stats_.hits;
+    entries_.splice(entries_.begin(), it->second);
+    return &it->second->second;
+  }
+
+  const Value* peek(const Key& key) const {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    ListIterator entry = it->second;
+    return &entry->second;
+  }
+
+  bool contains(const Key& key) const {
+    return index_.contains(key);
+  }
+
+  template<typename V>
+  void put(const Key& key, V&& value) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      it->second->second = std::forward<V>(value);
+      entries_.splice(entries_.begin(), it->second);
+      return;
+    }
+    if (entries_.size() >= capacity_) {
+      evict();
+    }
+    entries_.emplace(entries_.begin(), key, std::forward<V>(value));
+    index_.try_emplace(key, entries_.begin());
+  }
+
+  bool erase(const Key& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return false;
+    }
+    entries_.erase(it->second);
+    index_.erase(it);
+    return true;
+  }
+
+  void clear() {
+    index_.clear();
+    entries_.clear();
+  }
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  CacheStats stats() const {
+    return stats_;
+  }
+};
+
+// CLOCK (second chance) replacement over a fixed ring of slots. A hit only sets the reference bit
+// and never reorders anything, which keeps hits cheap; entries hit since the hand last passed
+// them survive one more sweep.
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class ClockCache {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using hasher = Hash;
+
+ private:
+  struct Slot {
+    Key key;
+    Value value;
+    bool referenced;
+  };
+
+  size_t capacity_;
+  std::vector<Slot> slots_;
+  UnorderedMap<Key, size_t, Hash, Equal> index_;
+  size_t hand_ = 0;
+  CacheStats stats_;
+
+  size_t evict() {
+    while (slots_[hand_].referenced) {
+      slots_[hand_].referenced = false;
+      hand_ = (hand_ + 1) % capacity_;
+    }
+    size_t victim = hand_;
+    hand_ = (hand_ + 1) % capacity_;
+    index_.erase(slots_[victim].key);
+    ++stats_.evictions;
+    return victim;
+  }
+
+ public:
+  explicit ClockCache(size_t capacity)
+      : capacity_(std::max<size_t>(capacity, 1)) {
+    slots_.reserve(capacity_);
+    index_.reserve(capacity_);
+  }
+
+  ClockCache(const ClockCache&) = delete;
+  ClockCache& operator=(const ClockCache&) = delete;
+
+  // The pointer stays valid until the entry is evicted or erased.
+  Value* get(const Key& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      ++stats_.misses;
+      return nullptr;
+    }
+    ++stats_.hits;
+    Slot& slot = slots_[it->second];
+    slot.referenced = true;
+    return &slot.value;
+  }
+
+  const Value* peek(const Key& key) const {
+    auto it = index_.find(key);
+    return it == index_.end() ? nullptr : &slots_[it->second].value;
+  }
+
+  bool contains(const Key& key) const {
+    return index_.contains(key);
+  }
+
+  template<typename V>
+  void put(const Key& key, V&& value) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      Slot& slot = slots_[it->second];
+      slot.value = std::forward<V>(value);
+      slot.referenced = true;
+      return;
+    }
+    if (slots_.size() < capacity_) {
+      slots_.push_back(Slot{key, std::forward<V>(value), false});
+      index_.try_emplace(key, slots_.size() - 1);
+      return;
+    }
+    size_t victim = evict();
+    slots_[victim].key = key;
+    slots_[victim].value = std::forward<V>(value);
+    slots_[victim].referenced = false;
+    index_.try_emplace(key, victim);
+  }
+
+  // The last slot is moved into the hole, so the ring stays dense.
+  bool erase(const Key& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return false;
+    }
+    size_t position = it->second;
+    index_.erase(it);
+    size_t last = slots_.size() - 1;
+    if (position != last) {
+      slots_[position] = std::move(slots_[last]);
+      index_.at(slots_[position].key) = position;
+    }
+    slots_.pop_back();
+    if (hand_ >= slots_.size()) {
+      hand_ = 0;
+    }
+    return true;
+  }
+
+  void clear() {
+    index_.clear();
+    slots_.clear();
+    hand_ = 0;
+  }
+
+  size_t size() const {
+    return slots_.size();
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  CacheStats stats() const {
+    return stats_;
+  }
+};
+
+// Scan-resistant segmented LRU in the spirit of 2Q: new entries go to a probation list and only
+// a hit there promotes them to the protected list, which holds up to protected_ratio of the
+// capacity. Evictions come from probation first, so a long scan of one-off keys cannot flush the
+// entries that are actually reused.
+template <typename Key,
+          typename Value,
+          typename Hash = std::hash<Key>,
+          typename Equal = std::equal_to<Key>>
+class SegmentedLruCache {
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using hasher = Hash;
+
+ private:
+  using ListType = List<std::pair<const Key, Value>>;
+  using ListIterator = typename ListType::iterator;
+
+  struct Entry {
+    ListIterator position;
+    bool is_protected;
+  };
+
+  size_t capacity_;
+  size_t protected_capacity_;
+  ListType probation_;
+  ListType protected_;
+  UnorderedMap<Key, Entry, Hash, Equal> index_;
+  CacheStats stats_;
+
+  void promote(Entry& entry) {
+    if (entry.is_protected) {
+      protected_.splice(protected_.begin(), entry.position);
+      return;
+    }
+    protected_.splice(protected_.begin(), probation_, entry.position);
+    entry.is_protected = true;
+    if (protected_.size() > protected_capacity_) {
+      ListIterator demoted = --protected_.end();
+      probation_.splice(probation_.begin(), protected_, demoted);
+      index_.at(demoted->first).is_protected = false;
+    }
+  }
+
+  void evict() {
+    ListType& victims = probation_.size() != 0 ? probation_ : protected_;
+    ListIterator victim = --victims.end();
+    index_.erase(victim->first);
+    victims.pop_back();
+    ++stats_.evictions;
+  }
+
+ public:
+  explicit SegmentedLruCache(size_t capacity, double protected_ratio = 0.8)
+      : capacity_(std::max<size_t>(capacity, 1)),
+        protected_capacity_(static_cast<size_t>(static_cast<double>(capacity_) * protected_ratio)) {
+    index_.reserve(capacity_);
+  }
+
+  SegmentedLruCache(const SegmentedLruCache&) = delete;
+  SegmentedLruCache& operator=(const SegmentedLruCache&) = delete;
+
+  // The pointer stays valid until the entry is evicted or erased.
+  Value* get(const Key& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      ++stats_.misses;
+      return nullptr;
+    }
+    ++stats_.hits;
+    promote(it->second);
+    return &it->second.position->second;
+  }
+
+  const Value* peek(const Key& key) const {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return nullptr;
+    }
+    ListIterator entry = it->second.position;
+    return &entry->second;
+  }
+
+  bool contains(const Key& key) const {
+    return index_.contains(key);
+  }
+
+  template<typename V>
+  void put(const Key& key, V&& value) {
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      it->second.position->second = std::forward<V>(value);
+      promote(it->second);
+      return;
+    }
+    if (size() >= capacity_) {
+      evict();
+    }
+    probation_.emplace(probation_.begin(), key, std::forward<V>(value));
+    index_.try_emplace(key, Entry{probation_.begin(), false});
+  }
+
+  bool erase(const Key& key) {
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return false;
+    }
+    (it->second.is_protected ? protected_ : probation_).erase(it->second.position);
+    index_.erase(it);
+    return true;
+  }
+
+  void clear() {
+    index_.clear();
+    probation_.clear();
+    protected_.clear();
+  }
+
+  size_t size() const {
+    return probation_.size() + protected_.size();
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  CacheStats stats() const {
+    return stats_;
+  }
+};
+
+// Thread-safe wrapper: the capacity is split over shards, each a Cache behind its own mutex.
+// Lookups return copies or run a callback under the lock, since a promoted entry may be evicted
+// by another thread as soon as the lock is released.
+template <typename Cache>
+class ShardedCache {
+ public:
+  using Key = typename Cache::key_type;
+  using Value = typename Cache::mapped_type;
+
+ private:
+  struct alignas(64) Shard {
+    explicit Shard(size_t capacity) : cache(capacity) {}
+
+    std::mutex mutex;
+    Cache cache;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  typename Cache::hasher hashFunc_;
+
+  Shard& shard_for(const Key& key) const {
+    return *shards_[mix_hash(hashFunc_(key)) % shards_.size()];
+  }
+
+ public:
+  explicit ShardedCache(size_t capacity, size_t shard_count = 16) {
+    shard_count = std::max<size_t>(std::min(shard_count, capacity), 1);
+    for (size_t i = 0; i < shard_count; ++i) {
+      shards_.push_back(std::make_unique<Shard>((capacity + shard_count - 1) / shard_count));
+    }
+  }
+
+  std::optional<Value> get(const Key& key) {
+    Shard& shard = shard_for(key);
+    std::lock_guard lock(shard.mutex);
+    Value* value = shard.cache.get(key);
+    if (value == nullptr) {
+      return std::nullopt;
+    }
+    return *value;
+  }
+
+  // Calls f(Value&) under the shard lock on a hit; f must not touch this cache.
+  template<typename F>
+  bool visit(const Key& key, F&& f) {
+    Shard& shard = shard_for(key);
+    std::lock_guard lock(shard.mutex);
+    Value* value = shard.cache.get(key);
+    if (value == nullptr) {
+      return false;
+    }
+    f(*value);
+    return true;
+  }
+
+  template<typename V>
+  void put(const Key& key, V&& value) {
+    Shard& shard = shard_for(key);
+    std::lock_guard lock(shard.mutex);
+    shard.cache.put(key, std::forward<V>(value));
+  }
+
+  bool erase(const Key& key) {
+    Shard& shard = shard_for(key);
+    std::lock_guard lock(shard.mutex);
+    return shard.cache.erase(key);
+  }
+
+  void clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard lock(shard->mutex);
+      shard->cache.clear();
+    }
+  }
+
+  size_t size() const {
+    size_t result = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard lock(shard->mutex);
+      result += shard->cache.size();
+    }
+    return result;
+  }
+
+  CacheStats stats() const {
+    CacheStats result;
+    for (auto& shard : shards_) {
+      std::lock_guard lock(shard->mutex);
+      result += shard->cache.stats();
+    }
+    return result;
+  }
+};
+
+
+
+
+
+
+
+// ======================================================================================================================================================================
+
+
+
+
+
+
+// Relational helpers on top of UnorderedMap. Rows are split into 2^bits partitions by the top bits
+// of their mixed key hash, so every partition gets a small table that stays in cache, and whole
+// partitions are handed to threads. With threads > 1 the key function, std::hash<Key> and the
+// aggregator are called concurrently; an exception from any of them is rethrown to the caller.
+inline unsigned radix_bits(size_t rows, size_t threads) {
+  static constexpr size_t rows_per_partition = 1 << 15;
+  static constexpr unsigned max_bits = 12;
+  size_t parts = std::max(rows / rows_per_partition, threads > 1 ? 4 * threads : 1);
+  unsigned bits = 0;
+  while ((size_t(1) << bits) < parts && bits < max_bits) {
+    ++bits;
+  }
+  return bits;
+}
+
+inline size_t radix_of(uint64_t hash, unsigned bits) {
+  return bits == 0 ? 0 : static_cast<size_t>(hash >> (64 - bits));
+}
+
+// Stable counting sort by partition: rows of partition p end up in out[begin[p], begin[p + 1])
+// in their original relative order. The rows themselves are scattered, not their indices, so
+// a partition is later read as one sequential run.
+template<typename Row>
+void radix_partition(const std::vector<Row*>& rows, const std::vector<uint64_t>& hashes, unsigned bits,
+                     std::vector<size_t>& begin, std::vector<Row*>& out) {
+  begin.assign((size_t(1) << bits) + 1, 0);
+  out.resize(rows.size());
+  for (uint64_t hash : hashes) {
+    ++begin[radix_of(hash, bits) + 1];
+  }
+  std::partial_sum(begin.begin(), begin.end(), begin.begin());
+  std::vector<size_t> cursor(begin.begin(), begin.end() - 1);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    out[cursor[radix_of(hashes[i], bits)]++] = rows[i];
+  }
+}
+
+template<typename Fn>
+void for_each_partition(size_t parts, size_t threads, Fn fn) {
+  if (threads == 0) {
+    threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+  threads = std::min(threads, parts);
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&]() {
+    for (size_t part = next++; part < parts; part = next++) {
+      try {
+        fn(part);
+      } catch (...) {
+        std::lock_guard lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        next = parts;
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads; ++t) {
+    try {
+      workers.emplace_back(worker);
+    } catch (const std::system_error&) {
+      break;
+    }
+  }
+  worker();
+  for (std::thread& thread : workers) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// Inner equi-join: returns a (build row, probe row) pointer pair for every pair of rows with equal
+// keys, grouped by partition. The build side of each partition goes into a pre-sized table of key
+// -> last row with that key, with the earlier rows chained behind it; the probe keys are looked up
+// with find_batch() in groups so their cache misses overlap.
+template<typename BuildRange, typename ProbeRange, typename KeyFn>
+auto hash_join(const BuildRange& build, const ProbeRange& probe, KeyFn key_fn, size_t threads = 1) {
+  using BuildRow = std::remove_reference_t<decltype(*std::begin(build))>;
+  using ProbeRow = std::remove_reference_t<decltype(*std::begin(probe))>;
+  using Key = std::decay_t<std::invoke_result_t<KeyFn&, BuildRow&>>;
+  using Match = std::pair<BuildRow*, ProbeRow*>;
+  static constexpr size_t no_row = static_cast<size_t>(-1);
+  static constexpr size_t probe_group = 64;
+
+  std::vector<BuildRow*> build_rows;
+  std::vector<ProbeRow*> probe_rows;
+  std::vector<uint64_t> build_hashes;
+  std::vector<uint64_t> probe_hashes;
+  std::hash<Key> hash;
+  for (BuildRow& row : build) {
+    build_rows.push_back(&row);
+    build_hashes.push_back(mix_hash(hash(key_fn(row))));
+  }
+  for (ProbeRow& row : probe) {
+    probe_rows.push_back(&row);
+    probe_hashes.push_back(mix_hash(hash(key_fn(row))));
+  }
+  unsigned bits = radix_bits(build_rows.size(), threads);
+  std::vector<size_t> build_begin, probe_begin;
+  std::vector<BuildRow*> build_sorted;
+  std::vector<ProbeRow*> probe_sorted;
+  radix_partition(build_rows, build_hashes, bits, build_begin, build_sorted);
+  radix_partition(probe_rows, probe_hashes, bits, probe_begin, probe_sorted);
+
+  size_t parts = size_t(1) << bits;
+  bool serial = threads == 1 || (threads == 0 && std::thread::hardware_concurrency() <= 1);
+  std::vector<Match> result;
+  std::vector<std::vector<Match>> matches(serial ? 0 : parts);
+  for_each_partition(parts, threads, [&](size_t part) {
+    std::vector<Match>& out = serial ? result : matches[part];
+    size_t build_count = build_begin[part + 1] - build_begin[part];
+    if (build_count == 0) {
+      return;
+    }
+    BuildRow* const* rows = build_sorted.data() + build_begin[part];
+    UnorderedMap<Key, size_t> last_row;
+    last_row.reserve(build_count);
+    std::vector<size_t> earlier(build_count, no_row);
+    for (size_t local = 0; local < build_count; ++local) {
+      auto [it, inserted] = last_row.try_emplace(key_fn(*rows[local]), local);
+      if (!inserted) {
+        earlier[local] = it->second;
+        it->second = local;
+      }
+    }
+
+    std::vector<Key> keys;
+    std::vector<typename UnorderedMap<Key, size_t>::const_iterator> found;
+    keys.reserve(probe_group);
+    const UnorderedMap<Key, size_t>& table = last_row;
+    for (size_t k = probe_begin[part]; k < probe_begin[part + 1]; k += probe_group) {
+      size_t group_end = std::min(k + probe_group, probe_begin[part + 1]);
+      keys.clear();
+      for (size_t j = group_end; j < std::min(group_end + probe_group, probe_begin[part + 1]); ++j) {
+        prefetch_read(probe_sorted[j]);
+      }
+      for (size_t j = k; j < group_end; ++j) {
+        keys.push_back(key_fn(*probe_sorted[j]));
+      }
+      table.find_batch(keys, found);
+      for (size_t j = 0; j < keys.size(); ++j) {
+        if (found[j] == table.end()) {
+          continue;
+        }
+        for (size_t local = found[j]->second; local != no_row; local = earlier[local]) {
+          out.emplace_back(rows[local], probe_sorted[k + j]);
+        }
+      }
+    }
+  });
+
+  size_t total = 0;
+  for (const std::vector<Match>& part : matches) {
+    total += part.size();
+  }
+  result.reserve(total);
+  for (const std::vector<Match>& part : matches) {
+    result.insert(result.end(), part.begin(), part.end());
+  }
+  return result;
+}
+
+// Folds every row into the accumulator of its key: agg(Acc& acc, const Row& row), accumulators
+// start value-initialized. Rows of one key always land in the same partition and keep their input
+// order, so agg does not have to be commutative. The tables are sized for expected_groups, or for
+// one group per row when it is zero, so building never rehashes; the partition tables are merged
+// into the result by relinking their nodes.
+template<typename Acc, typename Range, typename KeyFn, typename Agg>
+auto group_by_aggregate(const Range& range, KeyFn key_fn, Agg agg, size_t expected_groups = 0, size_t threads = 1) {
+  using Row = std::remove_reference_t<decltype(*std::begin(range))>;
+  using Key = std::decay_t<std::invoke_result_t<KeyFn&, Row&>>;
+  static constexpr size_t prefetch_distance = 8;
+
+  std::vector<Row*> rows;
+  std::vector<uint64_t> hashes;
+  std::hash<Key> hash;
+  for (Row& row : range) {
+    rows.push_back(&row);
+    hashes.push_back(mix_hash(hash(key_fn(row))));
+  }
+  UnorderedMap<Key, Acc> result;
+  unsigned bits = radix_bits(rows.size(), threads);
+  if (bits == 0) {
+    result.reserve(expected_groups != 0 ? expected_groups : rows.size());
+    for (Row* row : rows) {
+      agg(result.try_emplace(key_fn(*row)).first->second, *row);
+    }
+    return result;
+  }
+
+  std::vector<size_t> begin;
+  std::vector<Row*> sorted;
+  radix_partition(rows, hashes, bits, begin, sorted);
+  std::vector<UnorderedMap<Key, Acc>> partial(size_t(1) << bits);
+  for_each_partition(partial.size(), threads, [&](size_t part) {
+    size_t count = begin[part + 1] - begin[part];
+    partial[part].reserve(expected_groups != 0 ? std::min(count, expected_groups / partial.size() + 1) : count);
+    for (size_t k = begin[part]; k < begin[part + 1]; ++k) {
+      if (k + prefetch_distance < begin[part + 1]) {
+        prefetch_read(sorted[k + prefetch_distance]);
+      }
+      agg(partial[part].try_emplace(key_fn(*sorted[k])).first->second, *sorted[k]);
+    }
+  });
+  size_t groups = 0;
+  for (const UnorderedMap<Key, Acc>& part : partial) {
+    groups += part.size();
+  }
+  result.reserve(groups);
+  for (UnorderedMap<Key, Acc>& part : partial) {
+    result.merge(std::move(part));
+  }
+  return result;
+}